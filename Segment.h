@@ -3,14 +3,38 @@
 
 #include "include/GPoint.h"
 #include "include/GBitmap.h"
+#include "include/GRect.h"
 #include "include/GMath.h"
 #include <iostream>
 #include <vector>
 
+// 16.16 fixed point, used to step edges down the scanlines. It is kept in 64 bits so that
+// coordinates on devices wider or taller than 32767 pixels don't overflow.
+typedef int64_t GFixed;
+
+#define GFIXED_SHIFT  16
+#define GFIXED_ONE    (1 << GFIXED_SHIFT)
+#define GFIXED_HALF   (1 << (GFIXED_SHIFT - 1))
+
+// largest magnitude converted to fixed, so that its integer part still fits an int
+constexpr float gFixedMax = 1073741824.0f;   // 2^30
+
+static inline GFixed float_to_fixed(float x) {
+  x = std::max(-gFixedMax, std::min(gFixedMax, x));
+  return (GFixed) floorf(x * GFIXED_ONE + 0.5f);
+}
+
+// floor of a fixed value, i.e. the integer part
+static inline int fixed_floor(GFixed x) {
+  return (int) (x >> GFIXED_SHIFT);
+}
+
+// x is the intersection with the current row's center, pre-biased by 1/2 so that
+// a shift rounds it to the nearest pixel; dx is added once per row.
 struct Segment {
-  int top, bottom;
-  float m, x;
-  int winding;
+  GFixed x, dx;
+  int32_t top, bottom;
+  int32_t winding;
 
   Segment() {}
 
@@ -23,10 +47,11 @@ struct Segment {
     // we don't want horizontal lines
     assert(top >= 0 && bottom > top);
 
-    m = (p2.x - p1.x) / (p2.y - p1.y);
+    float m = (p2.x - p1.x) / (p2.y - p1.y);
     float b = p1.x - (m * p1.y);
 
-    x = m * (top + 0.5f) + b;
+    x = float_to_fixed(m * (top + 0.5f) + b) + GFIXED_HALF;
+    dx = float_to_fixed(m);
   }
 
   bool operator< (const Segment& line) const { return top > line.top; }
@@ -36,16 +61,32 @@ struct Segment {
   }
 
   int getIntersect() {
-    return GRoundToInt(x);
+    return fixed_floor(x);
   }
 
   int nextIntersect() {
-    int currX = GRoundToInt(x);
-    x += m;
+    int currX = fixed_floor(x);
+    x += dx;
     return currX;
   }
 };
 
+// the device pixels that filling between the segments can touch (spans end at an intersection)
+GIRect segments_bounds(const std::vector<Segment>& segments) {
+  if (segments.empty()) return GIRect::LTRB(0, 0, 0, 0);
+
+  GIRect r = GIRect::LTRB(INT32_MAX, INT32_MAX, INT32_MIN, INT32_MIN);
+
+  for (const Segment& s : segments) {
+    int first = fixed_floor(s.x);
+    int last = fixed_floor(s.x + s.dx * (s.bottom - s.top - 1));
+
+    r = GIRect::LTRB(std::min(r.left, std::min(first, last)), std::min(r.top, s.top),
+                     std::max(r.right, std::max(first, last)), std::max(r.bottom, s.bottom));
+  }
+  return r;
+}
+
 bool is_point_contained(const GBitmap& bm, const GPoint& p) {
   if (GRoundToInt(p.y) < 0 || GRoundToInt(p.y) >= bm.height()) return false;
   if (GRoundToInt(p.x) < 0 || GRoundToInt(p.x) >= bm.width()) return false;
@@ -54,13 +95,13 @@ bool is_point_contained(const GBitmap& bm, const GPoint& p) {
 }
 
 // returns true if we do not need to clip the segment at all
-bool is_segment_contained(const GBitmap& bm, const GPoint& a, const GPoint& b) {
+bool is_segment_contained(const GIRect& clip, const GPoint& a, const GPoint& b) {
   // we know that point a is the "top" point
-  if (GRoundToInt(a.y) < 0 || GRoundToInt(b.y) >= bm.height()) return false;
+  if (GRoundToInt(a.y) < clip.top || GRoundToInt(b.y) >= clip.bottom) return false;
 
-  if (a.x <= b.x && (a.x < 0.0f || b.x > bm.width())) {
+  if (a.x <= b.x && (a.x < clip.left || b.x > clip.right)) {
     return false;
-  } else if (a.x > b.x && (b.x < 0.0f || a.x > bm.width())) {
+  } else if (a.x > b.x && (b.x < clip.left || a.x > clip.right)) {
     return false;
   }
 
@@ -18,6 +18,9 @@ GWindow::GWindow(int width, int height) {
     fClick = NULL;
     fWidth = width;
     fHeight = height;
+    fNeedDraw = false;
+    fInval = GIRect::LTRB(0, 0, 0, 0);
+    fNeedPushAll = true;
 
     this->setupBitmap(width, height);
     fCanvas = GCreateCanvas(fBitmap);
@@ -59,12 +62,30 @@ void GWindow::pushEvent(int code) const {
 }
 
 void GWindow::requestDraw() {
+    fInval = GIRect::LTRB(0, 0, 0, 0);
     if (!fNeedDraw) {
         fNeedDraw = true;
         this->pushEvent(42);
     }
 }
 
+void GWindow::requestDraw(const GIRect& area) {
+    if (area.isEmpty()) {
+        return;
+    }
+    if (fNeedDraw) {
+        // a pending full redraw already covers it
+        if (!fInval.isEmpty()) {
+            fInval = GIRect::LTRB(std::min(fInval.left, area.left), std::min(fInval.top, area.top),
+                                  std::max(fInval.right, area.right), std::max(fInval.bottom, area.bottom));
+        }
+    } else {
+        fInval = area;
+        fNeedDraw = true;
+        this->pushEvent(42);
+    }
+}
+
 bool GWindow::handleEvent(const SDL_Event& evt) {
 //     printf("event %d\n", evt->type);
     switch (evt.type) {
@@ -84,6 +105,8 @@ bool GWindow::handleEvent(const SDL_Event& evt) {
                     this->setupBitmap(fWidth, fHeight);
                     fCanvas = GCreateCanvas(fBitmap);
                     fNeedDraw = true;
+                    fInval = GIRect::LTRB(0, 0, 0, 0);
+                    fNeedPushAll = true;
                     return true;
             }
             break;
@@ -175,8 +198,29 @@ int GWindow::run() {
 
         if (fNeedDraw) {
             fNeedDraw = false;  // clear this before we call onDraw
+
+            const GIRect inval = fInval;
+            fInval = GIRect::LTRB(0, 0, 0, 0);
+
+            fCanvas->save();
+            if (!inval.isEmpty()) {
+                fCanvas->clipRect(GRect::LTRB(inval.left, inval.top, inval.right, inval.bottom));
+            }
             this->onUpdate(fBitmap, fCanvas.get());
-            SDL_UpdateTexture(fTexture, nullptr, fBitmap.pixels(), fBitmap.rowBytes());
+            fCanvas->restore();
+
+            // only upload the pixels that were drawn
+            GIRect damage = fCanvas->getDamage();
+            fCanvas->resetDamage();
+            if (fNeedPushAll) {
+                damage = GIRect::WH(fBitmap.width(), fBitmap.height());
+                fNeedPushAll = false;
+            }
+            if (!damage.isEmpty()) {
+                SDL_Rect r = make(damage);
+                SDL_UpdateTexture(fTexture, &r, fBitmap.getAddr(damage.left, damage.top),
+                                  fBitmap.rowBytes());
+            }
         }
         SDL_RenderCopy(fRenderer, fTexture, nullptr, nullptr);
         this->onDrawOverlays();
@@ -10,16 +10,18 @@
 
 #include "../include/GBitmap.h"
 #include "../include/GPoint.h"
+#include "../include/GRect.h"
 
 class GCanvas;
 class GClick;
-class GIRect;
 
 class GWindow {
 public:
     int run();
 
     void requestDraw();
+    // only the area needs redrawing; onUpdate is called with the canvas clipped to it
+    void requestDraw(const GIRect& area);
 
 protected:
     GWindow(int initial_width, int initial_height);
@@ -47,6 +49,8 @@ private:
     int fWidth;
     int fHeight;
     bool fNeedDraw;
+    GIRect fInval;      // empty means redraw everything
+    bool fNeedPushAll;  // the texture was recreated and holds nothing yet
 
     SDL_Window*   fWindow;
     SDL_Renderer* fRenderer;
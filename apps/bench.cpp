@@ -3,11 +3,19 @@
  */
 
 #include "bench.h"
+#include "bench_perf.h"
+#include "bench_report.h"
 #include "../include/GCanvas.h"
 #include "../include/GBitmap.h"
+#include "../include/GProfile.h"
 #include "../include/GTime.h"
+#include "../include/GTrace.h"
+#include <algorithm>
+#include <atomic>
+#include <math.h>
 #include <memory>
 #include <string>
+#include <thread>
 #include <vector>
 #include <sys/stat.h>
 #include <unistd.h>
@@ -25,7 +33,71 @@ enum Mode {
     kOnce,
 };
 
-static double handle_proc(GBenchmark* bench, const char path[], GBitmap* bitmap, Mode mode) {
+// Each sample lasts at least kSampleNSec: iters is calibrated until it does.
+constexpr GNSec kSampleNSec = 5 * 1000 * 1000;
+constexpr int   kWarmupSamples = 2;
+constexpr int   kMaxIters = 1 << 20;
+
+// Runs per bench when the results are written as json or compared against it (see --runs).
+constexpr int   kCompareRuns = 3;
+
+static double time_draws(GBenchmark* bench, GCanvas* canvas, int iters) {
+    GNSec start = GTime::GetNSec();
+    for (int i = 0; i < iters; ++i) {
+        bench->draw(canvas);
+    }
+    return (GTime::GetNSec() - start) * 1e-6 / iters;
+}
+
+static BenchStats compute_stats(std::vector<double> times, int iters) {
+    BenchStats stats;
+    stats.iters = iters;
+    stats.samples = (int)times.size();
+    if (times.empty()) {
+        return stats;
+    }
+
+    std::sort(times.begin(), times.end());
+    const int n = (int)times.size();
+    stats.min = times[0];
+    stats.median = (n & 1) ? times[n/2] : (times[n/2 - 1] + times[n/2]) * 0.5;
+    stats.p90 = times[std::min(n - 1, (int)ceil(n * 0.9) - 1)];
+
+    // Times are skewed (a sample can only be slowed down), so the interval for the median is
+    // taken from the samples themselves rather than from the mean and stddev: the median lies
+    // between times[lo] and times[n-1-lo] unless more than lo samples fell on one side of it,
+    // which happens (by Binomial(n, 1/2)) with probability 2 * P(X <= lo) <= 5%. With fewer
+    // than 6 samples no lo is that unlikely, and the interval is just [min, max].
+    int lo = 0;
+    double term = pow(0.5, n);  // P(X == m)
+    double cdf = term;          // P(X <= m)
+    for (int m = 0; cdf <= 0.025 && m < n / 2;) {
+        lo = m;
+        m += 1;
+        term *= (double)(n - m + 1) / m;
+        cdf += term;
+    }
+    stats.medianLow = times[lo];
+    stats.medianHigh = times[n - 1 - lo];
+
+    double sum = 0;
+    for (double t : times) {
+        sum += t;
+    }
+    stats.mean = sum / n;
+
+    double var = 0;
+    for (double t : times) {
+        var += (t - stats.mean) * (t - stats.mean);
+    }
+    stats.stddev = n > 1 ? sqrt(var / (n - 1)) : 0;
+    return stats;
+}
+
+// Time one run of the bench, appending its samples (ms per draw) to [times].
+static BenchStats handle_proc(GBenchmark* bench, const char path[], GBitmap* bitmap, Mode mode,
+                              int samples, bool profile, BenchPerfCounters* perf,
+                              std::vector<double>* allTimes) {
     GISize size = bench->size();
     setup_bitmap(bitmap, size.width, size.height);
 
@@ -33,27 +105,198 @@ static double handle_proc(GBenchmark* bench, const char path[], GBitmap* bitmap,
     if (!canvas) {
         fprintf(stderr, "failed to create canvas for [%d %d] %s\n",
                 size.width, size.height, bench->name());
-        return 0;
+        return BenchStats();
+    }
+
+    switch (mode) {
+        case kNormal: break;
+        case kForever:
+            for (;;) {
+                bench->draw(canvas.get());
+            }
+        case kOnce:
+            if (perf) {
+                perf->start();
+            }
+            allTimes->push_back(time_draws(bench, canvas.get(), 4));
+            if (perf) {
+                perf->stop();
+            }
+            return compute_stats({ allTimes->back() }, 4);
     }
 
 #ifdef NDEBUG
-    int N = 100;
+    // Double the draws per sample until a sample is long enough for the clock to resolve it
+    // (this doubles as the first warmup), then throw away a few more before measuring.
+    int iters = 1;
+    while (iters < kMaxIters && time_draws(bench, canvas.get(), iters) * iters * 1e6 < kSampleNSec) {
+        iters *= 2;
+    }
+    for (int i = 0; i < kWarmupSamples; ++i) {
+        time_draws(bench, canvas.get(), iters);
+    }
 #else
-    int N = 1;
+    int iters = 1;
+    samples = 1;
 #endif
-    bool forever = false;
-    switch (mode) {
-        case kNormal: break;
-        case kForever: forever = true; break;
-        case kOnce: N = 4; break;
+
+    // only the measured samples are profiled, so the counters are per draw of the same runs
+    GProfile::Reset();
+    if (perf) {
+        perf->start();
+    }
+    std::vector<double> times;
+    for (int i = 0; i < samples; ++i) {
+        times.push_back(time_draws(bench, canvas.get(), iters));
+    }
+    if (perf) {
+        perf->stop();
+    }
+    if (profile) {
+        printf("%s profile, per draw:\n", bench->name());
+        GProfile::Dump(stdout, (double)samples * iters);
+    }
+    allTimes->insert(allTimes->end(), times.begin(), times.end());
+    return compute_stats(times, iters);
+}
+
+// Replays a trace made with GCreateTraceCanvas (see --trace), named after its file.
+class TraceBench : public GBenchmark {
+    std::unique_ptr<GTrace> fTrace;
+    std::string             fName;
+
+public:
+    TraceBench(std::unique_ptr<GTrace> trace, const char path[]) : fTrace(std::move(trace)) {
+        const char* slash = strrchr(path, '/');
+        fName = slash ? slash + 1 : path;
+    }
+
+    const char* name() const override { return fName.c_str(); }
+    GISize size() const override { return fTrace->size(); }
+    void draw(GCanvas* canvas) override { fTrace->playback(canvas); }
+};
+
+/**
+ *  Run [iters] draws on each of [threads] threads at once, returning the wall-clock ms for all
+ *  of them. Each thread makes its own bench, so no shader or other state is shared.
+ *
+ *  With banded, the threads split one bench-sized bitmap into horizontal bands, and each draws
+ *  the whole bench clipped to its band (so edges are still built by every thread). Otherwise
+ *  each thread draws into a bitmap of its own.
+ */
+static double time_threads(GBenchmark::Factory factory, int threads, int iters, bool banded) {
+    GISize size = std::unique_ptr<GBenchmark>(factory())->size();
+    if (banded) {
+        threads = std::min(threads, size.height);
+    }
+
+    std::vector<GBitmap> bitmaps(banded ? 1 : threads);
+    for (GBitmap& bm : bitmaps) {
+        setup_bitmap(&bm, size.width, size.height);
+    }
+
+    std::atomic<int> ready(0);
+    std::atomic<bool> go(false);
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; ++t) {
+        workers.emplace_back([&, t]() {
+            std::unique_ptr<GBenchmark> bench(factory());
+            GBitmap device = bitmaps[banded ? 0 : t];
+            int top = 0;
+            if (banded) {
+                top = size.height * t / threads;
+                int bottom = size.height * (t + 1) / threads;
+                device.reset(size.width, bottom - top, device.rowBytes(), device.getAddr(0, top),
+                             GBitmap::kNo_IsOpaque);
+            }
+            auto canvas = GCreateCanvas(device);
+            canvas->translate(0, (float)-top);
+
+            ready += 1;
+            while (!go) {
+                std::this_thread::yield();
+            }
+            for (int i = 0; i < iters; ++i) {
+                bench->draw(canvas.get());
+            }
+        });
+    }
+
+    while (ready < threads) {
+        std::this_thread::yield();
+    }
+    GNSec start = GTime::GetNSec();
+    go = true;
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+    double dur = (GTime::GetNSec() - start) * 1e-6;
+
+    for (GBitmap& bm : bitmaps) {
+        free(bm.pixels());
+    }
+    return dur;
+}
+
+constexpr GNSec kThreadRunNSec = 50 * 1000 * 1000;
+constexpr int   kThreadRuns = 3;
+
+static double median_threads(GBenchmark::Factory factory, int threads, int iters, bool banded) {
+    std::vector<double> durs;
+    for (int i = 0; i < kThreadRuns; ++i) {
+        durs.push_back(time_threads(factory, threads, iters, banded));
+    }
+    std::sort(durs.begin(), durs.end());
+    return durs[kThreadRuns / 2];
+}
+
+/**
+ *  Print how throughput scales from 1 to maxThreads threads (doubling, plus maxThreads itself):
+ *  "independent" is draws per second summed over threads that each own a canvas, so it shows
+ *  memory-bandwidth and shared-state limits; "banded" is how much faster one canvas finishes
+ *  when its rows are split between the threads. Both are given as ms per draw and as the
+ *  speedup over one thread. Benches that don't draw into the canvas they are given (see
+ *  GBenchmark::drawsToCanvas) can't be banded, and show n/a there.
+ */
+static void handle_scaling(GBenchmark::Factory factory, const char name[], int maxThreads) {
+#ifdef NDEBUG
+    int iters = 1;
+    while (iters < kMaxIters && time_threads(factory, 1, iters, false) * 1e6 < kThreadRunNSec) {
+        iters *= 2;
+    }
+#else
+    int iters = 1;
+#endif
+
+    time_threads(factory, 1, iters, false);     // warmup
+    const bool bandable = std::unique_ptr<GBenchmark>(factory())->drawsToCanvas();
+
+    printf("%s (%d draws per thread)\n", name, iters);
+    printf("  threads   independent ms  speedup    banded ms  speedup\n");
+
+    std::vector<int> counts;
+    for (int threads = 1; threads < maxThreads; threads *= 2) {
+        counts.push_back(threads);
     }
+    counts.push_back(maxThreads);
 
-    GMSec now = GTime::GetMSec();
-    for (int i = 0; i < N || forever; ++i) {
-        bench->draw(canvas.get());
+    double indep1 = 0, banded1 = 0;
+    for (int threads : counts) {
+        double indep = median_threads(factory, threads, iters, false) / (threads * iters);
+        if (threads == 1) {
+            indep1 = indep;
+        }
+        printf("  %7d %16.4f %7.2fx", threads, indep, indep1 / indep);
+        if (!bandable) {
+            printf(" %12s %8s\n", "n/a", "n/a");
+            continue;
+        }
+        double banded = median_threads(factory, threads, iters, true) / iters;
+        if (threads == 1) {
+            banded1 = banded;
+        }
+        printf(" %12.4f %7.2fx\n", banded, banded1 / banded);
     }
-    GMSec dur = GTime::GetMSec() - now;
-    return dur * 1.0 / N;
 }
 
 static bool is_arg(const char arg[], const char name[]) {
@@ -94,6 +337,17 @@ int main_bench(int argc, const char* argv[]) {
     std::vector<double> inScores;
     bool chatty_mode = true;
     bool write_images = false;
+    bool ci_mode = false;
+    int samples = 20;
+    int runs = 0;       // 0: one, or kCompareRuns when writing or comparing json
+    const char* jsonFile = nullptr;
+    const char* csvFile = nullptr;
+    std::vector<BenchResult> baseline;
+    double threshold = 0.05;
+    bool profile = false;
+    std::unique_ptr<BenchPerfCounters> perf;
+    int threads = 0;
+    std::vector<std::unique_ptr<GBenchmark>> traces;
 
     int count = -1;
     while (gBenchFactories[++count]);
@@ -118,6 +372,50 @@ int main_bench(int argc, const char* argv[]) {
             chatty_mode = false;
         } else if (is_arg(argv[i], "writeImages")) {
             write_images = true;
+        } else if (is_arg(argv[i], "samples") && i+1 < argc) {
+            samples = std::max(1, atoi(argv[++i]));
+        } else if (is_arg(argv[i], "runs") && i+1 < argc) {
+            runs = std::max(1, atoi(argv[++i]));
+        } else if (is_arg(argv[i], "ci")) {
+            ci_mode = true;
+        } else if (is_arg(argv[i], "threads") && i+1 < argc) {
+            threads = atoi(argv[++i]);
+            if (threads < 1) {
+                printf("Bad --threads %s\n", argv[i]);
+                return -1;
+            }
+        } else if (is_arg(argv[i], "perf")) {
+            perf.reset(new BenchPerfCounters);
+            if (!perf->available()) {
+                printf("perf counters unavailable (no perf_event_open, or a restrictive "
+                       "/proc/sys/kernel/perf_event_paranoid): timing only\n");
+                perf.reset();
+            }
+        } else if (is_arg(argv[i], "trace") && i+1 < argc) {
+            auto trace = GLoadTrace(argv[++i]);
+            if (!trace) {
+                printf("FAILED TO LOAD TRACE %s\n", argv[i]);
+                return -1;
+            }
+            traces.emplace_back(new TraceBench(std::move(trace), argv[i]));
+        } else if (is_arg(argv[i], "profile")) {
+            profile = true;
+        } else if (is_arg(argv[i], "json") && i+1 < argc) {
+            jsonFile = argv[++i];
+        } else if (is_arg(argv[i], "csv") && i+1 < argc) {
+            csvFile = argv[++i];
+        } else if (is_arg(argv[i], "compare") && i+1 < argc) {
+            if (!load_bench_json(argv[++i], &baseline)) {
+                printf("FAILED TO LOAD BASELINE %s\n", argv[i]);
+                return -1;
+            }
+        } else if (is_arg(argv[i], "threshold") && i+1 < argc) {
+            threshold = atof(argv[++i]);    // "5%" and "5" both parse as 5
+            if (threshold <= 0) {
+                printf("Bad --threshold %s\n", argv[i]);
+                return -1;
+            }
+            threshold /= 100;
         } else {
             printf("Unknown arg %s\n", argv[i]);
             return -1;
@@ -128,19 +426,100 @@ int main_bench(int argc, const char* argv[]) {
         printf("Can't compute --scoreFile without --inScores\n");
         return -1;
     }
+    if (ci_mode && inScores.size() == 0) {
+        printf("Can't compare with --ci without --inScores\n");
+        return -1;
+    }
+    if (traces.size() && (inScores.size() || threads > 0)) {
+        printf("Can't use --inScores or --threads with --trace\n");
+        return -1;
+    }
+    // traces replace the built-in benches
+    if (traces.size()) {
+        count = (int)traces.size();
+    }
+    if (runs == 0) {
+        runs = (jsonFile || baseline.size()) ? kCompareRuns : 1;
+    }
+    if (mode != kNormal || threads > 0) {
+        runs = 1;
+    }
 
     std::vector<double> durs;
+    std::vector<BenchResult> results;
     double quotient = 0;
-    for (int i = 0; i < count; ++i) {
-        std::unique_ptr<GBenchmark> bench(gBenchFactories[i]());
+    int slower = 0;
+
+    // What each bench has gathered over the runs so far.
+    struct Gathered {
+        std::vector<double> times;
+        std::vector<double> runs;
+        int                 iters = 0;
+        double              draws = 0;
+        double              counters[BenchPerfCounters::kCount] = {};
+    };
+    std::vector<Gathered> gathered(count);
+
+    // The runs are interleaved (every bench, then every bench again), so a stretch where the
+    // machine is slow lands in one run of many benches, rather than in every run of one.
+    for (int step = 0; step < runs * count; ++step) {
+        const int run = step / count, i = step % count;
+        std::unique_ptr<GBenchmark> owned;
+        if (traces.empty()) {
+            owned.reset(gBenchFactories[i]());
+        }
+        GBenchmark* bench = traces.empty() ? owned.get() : traces[i].get();
         const char* name = bench->name();
         
         if (match && !strstr(name, match)) {
             continue;
         }
+        if (threads > 0) {
+            handle_scaling(gBenchFactories[i], name, threads);
+            continue;
+        }
 
+        Gathered& g = gathered[i];
         GBitmap testBM;
-        double dur = handle_proc(bench.get(), name, &testBM, mode);
+        BenchStats stats = handle_proc(bench, name, &testBM, mode, samples, profile,
+                                       perf.get(), &g.times);
+        g.runs.push_back(stats.median);
+        g.iters = g.iters ? g.iters : stats.iters;
+        g.draws += (double)stats.samples * stats.iters;
+        if (perf) {
+            for (int c = 0; c < BenchPerfCounters::kCount; ++c) {
+                g.counters[c] += perf->value((BenchPerfCounters::Counter)c);
+            }
+        }
+
+        const bool lastRun = run == runs - 1;
+        if (lastRun && write_images) {
+            std::string str(name);
+            str += ".png";
+            testBM.writeToFile(str.c_str());
+        }
+        free(testBM.pixels());
+        if (!lastRun) {
+            continue;
+        }
+
+        if (runs > 1) {
+            stats = compute_stats(g.times, g.iters);
+        }
+        BenchResult result = { name, bench->size(), stats };
+        result.runs = g.runs;
+        if (perf) {
+            double draws = std::max(1.0, g.draws);
+            auto per_draw = [&](BenchPerfCounters::Counter c) {
+                return perf->has(c) ? g.counters[c] / draws : -1;
+            };
+            result.cycles = per_draw(BenchPerfCounters::kCycles);
+            result.instructions = per_draw(BenchPerfCounters::kInstructions);
+            result.cacheMisses = per_draw(BenchPerfCounters::kCacheMisses);
+            result.branchMisses = per_draw(BenchPerfCounters::kBranchMisses);
+        }
+        // The median is the score: unlike the mean, one preempted sample doesn't move it.
+        double dur = stats.median;
         if (chatty_mode) {
             printf("%s %g", name, dur);
         }
@@ -151,19 +530,53 @@ int main_bench(int argc, const char* argv[]) {
             }
             quotient += quo;
         }
+        if (chatty_mode) {
+            printf("  (min %g p90 %g sd %g, %dx%d)",
+                   stats.min, stats.p90, stats.stddev, stats.samples, stats.iters);
+        }
+        if (ci_mode) {
+            // The stored scores are medians: is the baseline outside the 95% confidence interval
+            // of our median?
+            const char* verdict = "same";
+            if (stats.medianLow > inScores[i]) {
+                verdict = "SLOWER";
+                slower += 1;
+            } else if (stats.medianHigh < inScores[i]) {
+                verdict = "faster";
+            }
+            if (chatty_mode) {
+                printf(" [%g, %g] %s", stats.medianLow, stats.medianHigh, verdict);
+            }
+        }
+        if (chatty_mode && perf) {
+            if (result.ipc() >= 0) {
+                printf("  ipc %.2f", result.ipc());
+            }
+            if (result.cacheMisses >= 0) {
+                printf("  cache-miss/px %.4f", result.perPixel(result.cacheMisses));
+            }
+            if (result.branchMisses >= 0) {
+                printf("  branch-miss/px %.4f", result.perPixel(result.branchMisses));
+            }
+        }
         if (chatty_mode) {
             printf("\n");
         }
         durs.push_back(dur);
-
-        if (write_images) {
-            std::string str(name);
-            str += ".png";
-            testBM.writeToFile(str.c_str());
-        }
-        free(testBM.pixels());
+        results.push_back(result);
     }
 
+    if (ci_mode) {
+        printf("%d significantly slower\n", slower);
+    }
+    if (jsonFile && !write_bench_json(jsonFile, results)) {
+        printf("FAILED TO WRITE TO %s\n", jsonFile);
+        return -1;
+    }
+    if (csvFile && !write_bench_csv(csvFile, results)) {
+        printf("FAILED TO WRITE TO %s\n", csvFile);
+        return -1;
+    }
     if (inScores.size()) {
         printf("score %.2f\n", quotient / count);
         if (scoreFile) {
@@ -191,5 +604,12 @@ int main_bench(int argc, const char* argv[]) {
             return -1;
         }
     }
+    if (baseline.size()) {
+        int regressions = compare_bench_results(baseline, results, threshold);
+        printf("%d regressions over %g%%\n", regressions, threshold * 100);
+        if (regressions > 0) {
+            return 1;
+        }
+    }
     return 0;
 }
@@ -17,6 +17,10 @@ public:
     virtual GISize size() const = 0;
     virtual void draw(GCanvas*) = 0;
 
+    // False for benches whose draw() ignores the canvas it is given (they draw into a device of
+    // their own, or don't draw at all), so splitting that canvas into bands can't split the work.
+    virtual bool drawsToCanvas() const { return true; }
+
     typedef GBenchmark* (*Factory)();
 };
 
@@ -0,0 +1,93 @@
+#include "bench_perf.h"
+
+#ifdef __linux__
+    #include <linux/perf_event.h>
+    #include <sys/ioctl.h>
+    #include <sys/syscall.h>
+    #include <unistd.h>
+    #include <string.h>
+#endif
+
+#ifdef __linux__
+
+static int open_counter(uint64_t config) {
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    // this thread, any cpu
+    return (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+BenchPerfCounters::BenchPerfCounters() {
+    static const uint64_t gConfigs[kCount] = {
+        PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES,
+    };
+    for (int i = 0; i < kCount; ++i) {
+        fFD[i] = open_counter(gConfigs[i]);
+        fValue[i] = 0;
+    }
+}
+
+BenchPerfCounters::~BenchPerfCounters() {
+    for (int fd : fFD) {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+}
+
+void BenchPerfCounters::start() {
+    for (int fd : fFD) {
+        if (fd >= 0) {
+            ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+}
+
+void BenchPerfCounters::stop() {
+    for (int i = 0; i < kCount; ++i) {
+        fValue[i] = 0;
+        if (fFD[i] < 0) {
+            continue;
+        }
+        ioctl(fFD[i], PERF_EVENT_IOC_DISABLE, 0);
+
+        uint64_t data[3];   // value, time enabled, time running
+        if (read(fFD[i], data, sizeof(data)) == sizeof(data) && data[2] > 0) {
+            fValue[i] = (double)data[0] * data[1] / data[2];
+        }
+    }
+}
+
+#else
+
+BenchPerfCounters::BenchPerfCounters() {
+    for (int i = 0; i < kCount; ++i) {
+        fFD[i] = -1;
+        fValue[i] = 0;
+    }
+}
+
+BenchPerfCounters::~BenchPerfCounters() {}
+void BenchPerfCounters::start() {}
+void BenchPerfCounters::stop() {}
+
+#endif
+
+bool BenchPerfCounters::available() const {
+    for (int fd : fFD) {
+        if (fd >= 0) {
+            return true;
+        }
+    }
+    return false;
+}
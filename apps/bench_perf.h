@@ -0,0 +1,41 @@
+#ifndef _bench_perf_h_DEFINED
+#define _bench_perf_h_DEFINED
+
+#include <stdint.h>
+
+/**
+ *  Hardware counters for the calling thread, read with perf_event_open (Linux only).
+ *
+ *  Each counter is opened on its own, so a kernel or VM that lacks one (cache-misses often is
+ *  missing under virtualization) still reports the others. When none can be opened, e.g. with
+ *  a restrictive /proc/sys/kernel/perf_event_paranoid or on other platforms, available() is
+ *  false and start()/stop() do nothing.
+ */
+class BenchPerfCounters {
+public:
+    enum Counter {
+        kCycles,
+        kInstructions,
+        kCacheMisses,
+        kBranchMisses,
+    };
+    static constexpr int kCount = kBranchMisses + 1;
+
+    BenchPerfCounters();
+    ~BenchPerfCounters();
+
+    bool available() const;
+    bool has(Counter c) const { return fFD[c] >= 0; }
+
+    void start();   // zero and enable
+    void stop();    // disable and read
+
+    // The count since start(), scaled up if the kernel had to multiplex the counter.
+    double value(Counter c) const { return fValue[c]; }
+
+private:
+    int    fFD[kCount];
+    double fValue[kCount];
+};
+
+#endif
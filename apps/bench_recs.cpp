@@ -16,6 +16,11 @@
 #include "bench_pa4.inc"
 #include "bench_pa5.inc"
 #include "bench_pa6.inc"
+#include "bench_picture.inc"
+#include "bench_float.inc"
+#include "bench_compact.inc"
+#include "bench_codec.inc"
+#include "bench_scene.inc"
 
 const GBenchmark::Factory gBenchFactories[] {
     []() -> GBenchmark* { return new ClearBench(); },
@@ -102,5 +107,22 @@ const GBenchmark::Factory gBenchFactories[] {
         return new QuadBench(colors, texs, "quad_mesh");
     },
 
+    []() -> GBenchmark* { return new OverdrawBench(false, "overdraw_direct");  },
+    []() -> GBenchmark* { return new OverdrawBench(true,  "overdraw_picture"); },
+    []() -> GBenchmark* { return new FloatRectsBench(); },
+    []() -> GBenchmark* { return new CompactRectsBench<GBitmapA8>(GCreateCanvasA8, "rects_blend_a8"); },
+    []() -> GBenchmark* { return new CompactRectsBench<GBitmap565>(GCreateCanvas565, "rects_blend_565"); },
+    []() -> GBenchmark* { return new DecodeBench("apps/spock.png", "decode_opaque"); },
+    []() -> GBenchmark* { return new DecodeBench("apps/wheel.png", "decode_alpha"); },
+    []() -> GBenchmark* { return new MapBench("apps/spock.png", "map_opaque"); },
+
+    // scenes at production resolutions
+    []() -> GBenchmark* { return new LionBench({1920, 1080}, "lion_1080p"); },
+    []() -> GBenchmark* { return new LionBench({3840, 2160}, "lion_4k"); },
+    []() -> GBenchmark* { return new UIBench({1920, 1080}, "ui_1080p"); },
+    []() -> GBenchmark* { return new UIBench({3840, 2160}, "ui_4k"); },
+    []() -> GBenchmark* { return new TexturedMeshBench({1920, 1080}, 100, 50, "mesh_10k_1080p"); },
+    []() -> GBenchmark* { return new SaveRestoreBench({1920, 1080}, 6, 4, "save_restore_deep"); },
+
     nullptr,
 };
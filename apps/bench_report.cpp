@@ -0,0 +1,275 @@
+#include "bench_report.h"
+#include "../include/GTypes.h"
+#include <algorithm>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+
+static std::string cpu_name() {
+    std::string name = "unknown";
+    FILE* f = fopen("/proc/cpuinfo", "r");
+    if (!f) {
+        return name;
+    }
+    char line[512];
+    while (fgets(line, sizeof(line), f)) {
+        // x86 calls it "model name", some arm kernels only give a "Hardware" line
+        if (!strncmp(line, "model name", 10) || !strncmp(line, "Hardware", 8)) {
+            const char* colon = strchr(line, ':');
+            if (colon) {
+                name = colon + 1 + strspn(colon + 1, " \t");
+                name.erase(name.find_last_not_of(" \t\n") + 1);
+                break;
+            }
+        }
+    }
+    fclose(f);
+    return name;
+}
+
+// The instruction sets the compiler was allowed to use, not everything the cpu supports.
+static const char* isa_name() {
+    return ""
+#if defined(__x86_64__)
+        "x86_64"
+#elif defined(__aarch64__)
+        "arm64"
+#elif defined(__arm__)
+        "arm"
+#else
+        "unknown"
+#endif
+#ifdef __SSE4_2__
+        " sse4.2"
+#endif
+#ifdef __AVX__
+        " avx"
+#endif
+#ifdef __AVX2__
+        " avx2"
+#endif
+#ifdef __FMA__
+        " fma"
+#endif
+#ifdef __AVX512F__
+        " avx512f"
+#endif
+#ifdef __ARM_NEON
+        " neon"
+#endif
+    ;
+}
+
+static std::string json_escape(const std::string& str) {
+    std::string out;
+    for (char c : str) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+        }
+        out += c;
+    }
+    return out;
+}
+
+bool write_bench_json(const char path[], const std::vector<BenchResult>& results) {
+    FILE* f = fopen(path, "w");
+    if (!f) {
+        return false;
+    }
+    fprintf(f, "{\n");
+    fprintf(f, "  \"cpu\": \"%s\",\n", json_escape(cpu_name()).c_str());
+    fprintf(f, "  \"isa\": \"%s\",\n", isa_name());
+    fprintf(f, "  \"hardware_threads\": %u,\n", std::thread::hardware_concurrency());
+    fprintf(f, "  \"benches\": [\n");
+    for (size_t i = 0; i < results.size(); ++i) {
+        const BenchResult& r = results[i];
+        const BenchStats& s = r.stats;
+        fprintf(f, "    {\"name\": \"%s\", \"width\": %d, \"height\": %d, \"samples\": %d, "
+                   "\"iters\": %d, \"ns_per_op\": %.1f, \"min_ns\": %.1f, \"p90_ns\": %.1f, "
+                   "\"mean_ns\": %.1f, \"stddev_ns\": %.1f, \"pixels_per_sec\": %.0f",
+                json_escape(r.name).c_str(), r.size.width, r.size.height, s.samples, s.iters,
+                s.median * 1e6, s.min * 1e6, s.p90 * 1e6, s.mean * 1e6, s.stddev * 1e6,
+                r.pixelsPerSec());
+        fprintf(f, ", \"run_ns\": [");
+        for (size_t k = 0; k < r.runs.size(); ++k) {
+            fprintf(f, "%s%.1f", k ? ", " : "", r.runs[k] * 1e6);
+        }
+        fprintf(f, "]");
+        // the counters the run couldn't open are left out
+        if (r.cycles >= 0) {
+            fprintf(f, ", \"cycles\": %.0f", r.cycles);
+        }
+        if (r.ipc() >= 0) {
+            fprintf(f, ", \"ipc\": %.3f", r.ipc());
+        }
+        if (r.cacheMisses >= 0) {
+            fprintf(f, ", \"cache_misses_per_px\": %.5f", r.perPixel(r.cacheMisses));
+        }
+        if (r.branchMisses >= 0) {
+            fprintf(f, ", \"branch_misses_per_px\": %.5f", r.perPixel(r.branchMisses));
+        }
+        fprintf(f, "}%s\n", i + 1 < results.size() ? "," : "");
+    }
+    fprintf(f, "  ]\n}\n");
+    return fclose(f) == 0;
+}
+
+bool write_bench_csv(const char path[], const std::vector<BenchResult>& results) {
+    FILE* f = fopen(path, "w");
+    if (!f) {
+        return false;
+    }
+    std::string cpu = cpu_name();
+    fprintf(f, "name,width,height,samples,iters,ns_per_op,min_ns,p90_ns,mean_ns,stddev_ns,"
+               "pixels_per_sec,cpu,isa\n");
+    for (const BenchResult& r : results) {
+        const BenchStats& s = r.stats;
+        fprintf(f, "%s,%d,%d,%d,%d,%.1f,%.1f,%.1f,%.1f,%.1f,%.0f,\"%s\",%s\n",
+                r.name.c_str(), r.size.width, r.size.height, s.samples, s.iters,
+                s.median * 1e6, s.min * 1e6, s.p90 * 1e6, s.mean * 1e6, s.stddev * 1e6,
+                r.pixelsPerSec(), cpu.c_str(), isa_name());
+    }
+    return fclose(f) == 0;
+}
+
+// Find "key": in line and parse the number after it.
+static bool json_number(const char line[], const char key[], double* value) {
+    std::string quoted = std::string("\"") + key + "\":";
+    const char* p = strstr(line, quoted.c_str());
+    if (!p) {
+        return false;
+    }
+    char* end;
+    *value = strtod(p + quoted.size(), &end);
+    return end != p + quoted.size();
+}
+
+static bool json_string(const char line[], const char key[], std::string* value) {
+    std::string quoted = std::string("\"") + key + "\": \"";
+    const char* p = strstr(line, quoted.c_str());
+    if (!p) {
+        return false;
+    }
+    value->clear();
+    for (p += quoted.size(); *p && *p != '"'; ++p) {
+        if (*p == '\\' && p[1]) {
+            ++p;
+        }
+        *value += *p;
+    }
+    return *p == '"';
+}
+
+// Find "key": [ in line and parse the numbers in the array.
+static bool json_numbers(const char line[], const char key[], std::vector<double>* values) {
+    std::string quoted = std::string("\"") + key + "\": [";
+    const char* p = strstr(line, quoted.c_str());
+    if (!p) {
+        return false;
+    }
+    values->clear();
+    for (p += quoted.size(); *p != ']';) {
+        char* end;
+        values->push_back(strtod(p, &end));
+        if (end == p) {
+            values->clear();
+            return false;
+        }
+        p = end + strspn(end, ", ");
+    }
+    return true;
+}
+
+bool load_bench_json(const char path[], std::vector<BenchResult>* results) {
+    FILE* f = fopen(path, "r");
+    if (!f) {
+        return false;
+    }
+    results->clear();
+
+    // We only read what write_bench_json() writes: each bench is on a line of its own.
+    char line[1024];
+    while (fgets(line, sizeof(line), f)) {
+        BenchResult r;
+        double w, h, samples, iters;
+        if (!json_string(line, "name", &r.name) ||
+            !json_number(line, "width", &w) || !json_number(line, "height", &h) ||
+            !json_number(line, "samples", &samples) || !json_number(line, "iters", &iters) ||
+            !json_number(line, "ns_per_op", &r.stats.median) ||
+            !json_number(line, "mean_ns", &r.stats.mean) ||
+            !json_number(line, "stddev_ns", &r.stats.stddev)) {
+            continue;
+        }
+        json_number(line, "min_ns", &r.stats.min);
+        json_number(line, "p90_ns", &r.stats.p90);
+        json_numbers(line, "run_ns", &r.runs);     // older files have no runs
+
+        r.size = { (int)w, (int)h };
+        r.stats.samples = (int)samples;
+        r.stats.iters = (int)iters;
+        for (double* ms : { &r.stats.median, &r.stats.mean, &r.stats.stddev,
+                            &r.stats.min, &r.stats.p90 }) {
+            *ms *= 1e-6;
+        }
+        for (double& ms : r.runs) {
+            ms *= 1e-6;
+        }
+        results->push_back(r);
+    }
+    fclose(f);
+    return !results->empty();
+}
+
+int compare_bench_results(const std::vector<BenchResult>& baseline,
+                          const std::vector<BenchResult>& results, double threshold) {
+    int regressions = 0;
+    for (const BenchResult& r : results) {
+        const BenchResult* base = nullptr;
+        for (const BenchResult& b : baseline) {
+            if (b.name == r.name) {
+                base = &b;
+                break;
+            }
+        }
+        if (!base) {
+            printf("%-24s new\n", r.name.c_str());
+            continue;
+        }
+
+        if (base->runs.size() < 2 || r.runs.size() < 2) {
+            double change = base->stats.median > 0 ? r.stats.median / base->stats.median - 1 : 0;
+            printf("%-24s %10.4f -> %10.4f ms %+6.1f%% (one run: noise unknown, not gated)\n",
+                   r.name.c_str(), base->stats.median, r.stats.median, change * 100);
+            continue;
+        }
+
+        // interference only ever adds time, so each side's fastest run is its best estimate
+        auto [baseMin, baseMax] = std::minmax_element(base->runs.begin(), base->runs.end());
+        auto [runMin, runMax] = std::minmax_element(r.runs.begin(), r.runs.end());
+        double change = *runMin / *baseMin - 1;
+        double noise = std::max(*baseMax / *baseMin, *runMax / *runMin) - 1;
+        double floor = std::max(threshold, noise);
+
+        const char* verdict = "same";
+        if (*runMin > *baseMax && change > floor) {
+            verdict = "REGRESSED";
+            regressions += 1;
+        } else if (*runMax < *baseMin && -change > floor) {
+            verdict = "improved";
+        }
+        printf("%-24s %10.4f -> %10.4f ms %+6.1f%% (noise %.1f%%) %s\n",
+               r.name.c_str(), *baseMin, *runMin, change * 100, noise * 100, verdict);
+    }
+    for (const BenchResult& b : baseline) {
+        bool found = false;
+        for (const BenchResult& r : results) {
+            found |= (b.name == r.name);
+        }
+        if (!found) {
+            printf("%-24s not run\n", b.name.c_str());
+        }
+    }
+    return regressions;
+}
@@ -0,0 +1,68 @@
+#ifndef _bench_report_h_DEFINED
+#define _bench_report_h_DEFINED
+
+#include "../include/GPoint.h"
+#include <string>
+#include <vector>
+
+/**
+ *  Timings of one bench, in milliseconds per draw. Each sample times [iters] draws in a row.
+ */
+struct BenchStats {
+    int    iters = 0;
+    int    samples = 0;
+    double min = 0, median = 0, p90 = 0, mean = 0, stddev = 0;
+
+    // A 95% confidence interval for the median (see compute_stats in bench.cpp).
+    double medianLow = 0, medianHigh = 0;
+};
+
+struct BenchResult {
+    std::string name;
+    GISize      size = { 0, 0 };
+    BenchStats  stats;
+
+    // The median of each run (see bench --runs), in the order they ran. Runs are timed apart,
+    // so how much these differ is the noise that one run's samples can't show.
+    std::vector<double> runs;
+
+    // Hardware counters per draw (see BenchPerfCounters), or -1 when they weren't collected.
+    double      cycles = -1, instructions = -1, cacheMisses = -1, branchMisses = -1;
+
+    double pixelsPerSec() const {
+        return stats.median > 0 ? size.width * (double)size.height * 1000 / stats.median : 0;
+    }
+    double ipc() const {
+        return cycles > 0 && instructions >= 0 ? instructions / cycles : -1;
+    }
+    double perPixel(double count) const {
+        return count >= 0 ? count / ((double)size.width * size.height) : -1;
+    }
+};
+
+/**
+ *  Write the results, with the cpu and the instruction sets we were compiled for, as JSON (one
+ *  bench per line) or as CSV (one header row, then one row per bench). Times are ns per draw.
+ *  Return false if the file could not be written.
+ */
+bool write_bench_json(const char path[], const std::vector<BenchResult>&);
+bool write_bench_csv(const char path[], const std::vector<BenchResult>&);
+
+/**
+ *  Read back a file written by write_bench_json(). Return false if it could not be opened or
+ *  holds no benches.
+ */
+bool load_bench_json(const char path[], std::vector<BenchResult>*);
+
+/**
+ *  Match each result to the baseline bench with the same name, and compare their fastest runs.
+ *  A bench regressed when every one of its runs is slower than every baseline run, and by more
+ *  than both [threshold] (e.g. 0.05) and the noise: how far apart the runs of either side are.
+ *  Samples within one run share whatever state the machine was in, so they can't show that
+ *  noise; a bench with fewer than two runs on either side is listed but never fails, as are
+ *  benches missing from either side. Return the number of regressions.
+ */
+int compare_bench_results(const std::vector<BenchResult>& baseline,
+                          const std::vector<BenchResult>& results, double threshold);
+
+#endif
@@ -130,6 +130,21 @@ public:
     virtual GRect getRect() = 0;
     virtual void setRect(const GRect&) {}
     virtual bool animates() const { return false; }
+    // true if draw() stays within getRect(), so a change only needs that area redrawn
+    virtual bool isBoundedByRect() const { return false; }
+
+    // device area that draw() and drawHilite() can touch
+    GIRect getDirtyBounds() {
+        GRect r = this->getRect();
+        if (fShaderType != kColor_ShaderType) {
+            for (int i = 0; i < 2; ++i) {
+                r = GRect::LTRB(std::min(r.left, fGradPts[i].x), std::min(r.top, fGradPts[i].y),
+                                std::max(r.right, fGradPts[i].x), std::max(r.bottom, fGradPts[i].y));
+            }
+        }
+        const float pad = CORNER_SIZE + 3;
+        return GRect::LTRB(r.left - pad, r.top - pad, r.right + pad, r.bottom + pad).roundOut();
+    }
 
     GColor getColor() {
         if (fShaderType == kGradient_ShaderType) {
@@ -322,6 +337,7 @@ public:
 
     GRect getRect() override { return fRect; }
     void setRect(const GRect& r) override { fRect = r; }
+    bool isBoundedByRect() const override { return true; }
     GColor onGetColor() override { return fColor; }
     void onSetColor(const GColor& c) override { fColor = c; }
 
@@ -573,9 +589,10 @@ protected:
             GPoint anchor;
             if (in_resize_corner(fShape->getRect(), loc.x, loc.y, &anchor)) {
                 return new GClick(loc, [this, anchor](GClick* click) {
+                    const GIRect before = fShape->getDirtyBounds();
                     fShape->setRect(make_from_pts(click->curr(), anchor));
                     this->updateTitle();
-                    this->requestDraw();
+                    this->requestShapeDraw(fShape, before);
                 });
             }
         }
@@ -587,9 +604,10 @@ protected:
                 return new GClick(loc, [this](GClick* click) {
                     const GPoint curr = click->curr();
                     const GPoint prev = click->prev();
+                    const GIRect before = fShape->getDirtyBounds();
                     fShape->offset(curr.x - prev.x, curr.y - prev.y);
                     this->updateTitle();
-                    this->requestDraw();
+                    this->requestShapeDraw(fShape, before);
                 });
             }
         }
@@ -606,13 +624,27 @@ protected:
                     return;
                 }
             }
+            const GIRect before = fShape->getDirtyBounds();
             fShape->setRect(make_from_pts(click->orig(), click->curr()));
             this->updateTitle();
-            this->requestDraw();
+            this->requestShapeDraw(fShape, before);
         });
     }
 
 private:
+    // redraw only where the shape was and now is, when that bounds everything it draws
+    void requestShapeDraw(Shape* shape, const GIRect& before) {
+        if (!shape->isBoundedByRect()) {
+            this->requestDraw();
+            return;
+        }
+        const GIRect after = shape->getDirtyBounds();
+        this->requestDraw(GIRect::LTRB(std::min(before.left, after.left),
+                                       std::min(before.top, after.top),
+                                       std::max(before.right, after.right),
+                                       std::max(before.bottom, after.bottom)));
+    }
+
     void removeShape(Shape* target) {
         assert(target);
 
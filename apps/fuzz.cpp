@@ -0,0 +1,378 @@
+/**
+ *  Looks for inputs that crash the rasterizer, or that take far longer than their size warrants.
+ *
+ *  Each trial builds one extreme input with GRandom (huge coordinates, near-horizontal edges,
+ *  degenerate and giant cubics, paths of up to 10^5 segments, degenerate meshes) and draws it
+ *  in a child process, so an assert or a crash is reported rather than ending the run, and a
+ *  draw that stalls is killed after --timeout seconds. A draw that takes longer than a budget
+ *  for its size (a fixed cost, plus a cost per segment) is reported as slow.
+ *
+ *  Then each kind of input is drawn with 10^4 and with 10^5 segments, and reported if its time
+ *  grows faster than n^1.5.
+ *
+ *  usage: fuzz [--trials N] [--seed S] [--kind NAME] [--timeout SEC] [--verbose]
+ *
+ *  Every report ends with the command that reproduces it.
+ */
+
+#include "../include/GBitmap.h"
+#include "../include/GCanvas.h"
+#include "../include/GPath.h"
+#include "../include/GRandom.h"
+#include "../include/GTime.h"
+#include <math.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+static const int kSize = 256;
+
+// budget for one draw: generous, since a pathology is orders of magnitude over, not 2x (a
+// segment can be a giant cubic, flattened into as many lines as clipping allows)
+static const double kBudgetMS = 250;
+static const double kBudgetMSPerSegment = 0.25;
+
+// One input to draw: a path, a convex polygon, or a mesh.
+struct FuzzInput {
+    enum Type { kPath, kPolygon, kMesh } type = kPath;
+    GPath               path;
+    std::vector<GPoint> pts;        // polygon, or mesh verts
+    std::vector<GColor> colors;     // mesh
+    std::vector<int>    indices;    // mesh
+    int                 segments = 0;
+
+    void draw(GCanvas* canvas) const {
+        GPaint paint({0.2f, 0.6f, 0.4f, 0.8f});
+        switch (type) {
+            case kPath:
+                canvas->drawPath(path, paint);
+                break;
+            case kPolygon:
+                canvas->drawConvexPolygon(pts.data(), (int)pts.size(), paint);
+                break;
+            case kMesh:
+                canvas->drawMesh(pts.data(), colors.empty() ? nullptr : colors.data(), nullptr,
+                                 (int)indices.size() / 3, indices.data(), paint);
+                break;
+        }
+    }
+};
+
+static float sign(GRandom& rand) { return rand.nextRange(0, 1) ? 1 : -1; }
+
+// somewhere on the device, give or take a little
+static float device_coord(GRandom& rand) { return rand.nextF() * (kSize + 20) - 10; }
+
+// anything from on the device to 1e30 away from it
+static float huge_coord(GRandom& rand) {
+    if (rand.nextRange(0, 3) == 0) {
+        return device_coord(rand);
+    }
+    return sign(rand) * powf(10, rand.nextF() * 30);
+}
+
+static GPoint device_point(GRandom& rand) { return { device_coord(rand), device_coord(rand) }; }
+static GPoint huge_point(GRandom& rand) { return { huge_coord(rand), huge_coord(rand) }; }
+
+// a random verb through points from make()
+template <typename Make> static void add_verb(GRandom& rand, GPath* path, Make make) {
+    switch (rand.nextRange(0, 2)) {
+        case 0: path->lineTo(make()); break;
+        case 1: path->quadTo(make(), make()); break;
+        case 2: path->cubicTo(make(), make(), make()); break;
+    }
+}
+
+static void make_huge_path(GRandom& rand, int n, FuzzInput* input) {
+    input->path.moveTo(huge_point(rand));
+    for (int i = 0; i < n; ++i) {
+        add_verb(rand, &input->path, [&]() { return huge_point(rand); });
+    }
+    input->segments = n;
+}
+
+// a zigzag whose edges each climb a hair while spanning (up to) a million pixels across
+static void make_near_horizontal(GRandom& rand, int n, FuzzInput* input) {
+    float y = device_coord(rand);
+    input->path.moveTo(-1e6f * rand.nextF(), y);
+    for (int i = 0; i < n; ++i) {
+        y += sign(rand) * powf(10, -6 + rand.nextF() * 6);
+        float x = (i & 1 ? 1 : -1) * powf(10, rand.nextF() * 6);
+        input->path.lineTo(x, y);
+    }
+    input->segments = n;
+}
+
+// cubics that collapse to points or lines, have cusps, or have their control points out in
+// the billions while both ends stay on the device
+static void make_degenerate_cubics(GRandom& rand, int n, FuzzInput* input) {
+    GPoint p = device_point(rand);
+    input->path.moveTo(p);
+    for (int i = 0; i < n; ++i) {
+        GPoint a = device_point(rand), b = device_point(rand), end = device_point(rand);
+        float far = powf(10, 3 + rand.nextF() * 17);
+        switch (rand.nextRange(0, 4)) {
+            case 0: a = b = end = p; break;                                 // a point
+            case 1: a = p; b = end; break;                                  // a line
+            case 2: std::swap(a, b); end = p; break;                        // loops back
+            case 3: a = { p.x + far, p.y }; b = { end.x - far, end.y }; break;
+            case 4: a = { p.x, p.y + sign(rand) * far }; b = { far, -far }; break;
+        }
+        input->path.cubicTo(a, b, end);
+        p = end;
+    }
+    input->segments = n;
+}
+
+// a long path that stays on the device, where only the number of edges is extreme
+static void make_long_path(GRandom& rand, int n, FuzzInput* input) {
+    input->path.moveTo(device_point(rand));
+    for (int i = 0; i < n; ++i) {
+        add_verb(rand, &input->path, [&]() { return device_point(rand); });
+    }
+    input->path.setFillType((GPath::FillType)rand.nextRange(0, 3));
+    input->segments = n;
+}
+
+// a regular polygon of n sides, with a radius and center anywhere from tiny to 1e30
+static void make_polygon(GRandom& rand, int n, FuzzInput* input) {
+    input->type = FuzzInput::kPolygon;
+    GPoint center = rand.nextRange(0, 1) ? device_point(rand) : huge_point(rand);
+    float radius = powf(10, -3 + rand.nextF() * 33);
+    for (int i = 0; i < n; ++i) {
+        float angle = i * 6.2831853f / n;
+        input->pts.push_back({ center.x + radius * cosf(angle), center.y + radius * sinf(angle) });
+    }
+    input->segments = n;
+}
+
+// triangles that are huge, slivers, or collapsed to lines and points
+static void make_mesh(GRandom& rand, int n, FuzzInput* input) {
+    input->type = FuzzInput::kMesh;
+    for (int i = 0; i < n; ++i) {
+        GPoint a = rand.nextRange(0, 1) ? device_point(rand) : huge_point(rand);
+        GPoint b = huge_point(rand), c = device_point(rand);
+        switch (rand.nextRange(0, 3)) {
+            case 0: c = a; break;                                           // a line
+            case 1: b = c = a; break;                                       // a point
+            case 2: c = { (a.x + b.x) * 0.5f, (a.y + b.y) * 0.5f }; break;  // collinear
+            case 3: b = { a.x + 1e6f, a.y + 1e-3f }; break;                 // a sliver
+        }
+        int base = (int)input->pts.size();
+        input->pts.insert(input->pts.end(), { a, b, c });
+        input->indices.insert(input->indices.end(), { base, base + 1, base + 2 });
+    }
+    if (rand.nextRange(0, 1)) {
+        for (size_t i = 0; i < input->pts.size(); ++i) {
+            input->colors.push_back({ rand.nextF(), rand.nextF(), rand.nextF(), 1 });
+        }
+    }
+    input->segments = n;
+}
+
+struct FuzzKind {
+    const char* name;
+    void (*make)(GRandom&, int n, FuzzInput*);
+};
+
+static const FuzzKind gKinds[] = {
+    { "huge_path",          make_huge_path         },
+    { "near_horizontal",    make_near_horizontal   },
+    { "degenerate_cubics",  make_degenerate_cubics },
+    { "long_path",          make_long_path         },
+    { "polygon",            make_polygon           },
+    { "mesh",               make_mesh              },
+};
+static const int kKindCount = sizeof(gKinds) / sizeof(gKinds[0]);
+
+// up to 10^5 segments, spread evenly over the orders of magnitude
+static int pick_count(GRandom& rand) {
+    return std::max(3, (int)powf(10, rand.nextF() * 5));
+}
+
+// the fastest of [reps] draws, in ms
+static double time_draw(const FuzzInput& input, int reps) {
+    GBitmap bitmap;
+    bitmap.alloc(kSize, kSize);
+    auto canvas = GCreateCanvas(bitmap);
+
+    double best = 1e30;
+    for (int i = 0; i < reps; ++i) {
+        canvas->clear({0, 0, 0, 0});
+        GNSec start = GTime::GetNSec();
+        input.draw(canvas.get());
+        best = std::min(best, (GTime::GetNSec() - start) * 1e-6);
+    }
+    free(bitmap.pixels());
+    return best;
+}
+
+/**
+ *  Run proc() in a child process, killed after [timeout] seconds, and pass back the doubles
+ *  it returns. Return a description of how the child died, or an empty string if it didn't.
+ */
+template <typename Proc>
+static std::string run_child(int timeout, Proc proc, std::vector<double>* results) {
+    int fds[2];
+    if (pipe(fds) != 0) {
+        return "pipe failed";
+    }
+    fflush(stdout);
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        close(fds[0]);
+        alarm(timeout);
+        std::vector<double> values = proc();
+        ssize_t size = values.size() * sizeof(double);
+        _exit(write(fds[1], values.data(), size) == size ? 0 : 1);
+    }
+    close(fds[1]);
+
+    double value;
+    while (read(fds[0], &value, sizeof(value)) == sizeof(value)) {
+        results->push_back(value);
+    }
+    close(fds[0]);
+
+    int status = 0;
+    waitpid(pid, &status, 0);
+    if (WIFSIGNALED(status)) {
+        int sig = WTERMSIG(status);
+        if (sig == SIGALRM) {
+            return "TIMEOUT after " + std::to_string(timeout) + "s";
+        }
+        return std::string(sig == SIGABRT ? "ASSERT" : "CRASH") + " (" + strsignal(sig) + ")";
+    }
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0 ? "" : "exited with an error";
+}
+
+static bool is_arg(const char arg[], const char name[]) {
+    std::string str("--");
+    str += name;
+    if (!strcmp(arg, str.c_str())) {
+        return true;
+    }
+
+    char shortVers[3];
+    shortVers[0] = '-';
+    shortVers[1] = name[0];
+    shortVers[2] = 0;
+    return !strcmp(arg, shortVers);
+}
+
+int main(int argc, const char* argv[]) {
+    int trials = 200;
+    uint32_t seed = 1;
+    const char* kindName = nullptr;
+    int timeout = 30;       // past the budget for 10^5 segments, so slow is told from stuck
+    bool verbose = false;
+
+    for (int i = 1; i < argc; ++i) {
+        if (is_arg(argv[i], "trials") && i+1 < argc) {
+            trials = atoi(argv[++i]);
+        } else if (is_arg(argv[i], "seed") && i+1 < argc) {
+            seed = (uint32_t)atol(argv[++i]);
+        } else if (is_arg(argv[i], "kind") && i+1 < argc) {
+            kindName = argv[++i];
+        } else if (is_arg(argv[i], "timeout") && i+1 < argc) {
+            timeout = std::max(1, atoi(argv[++i]));
+        } else if (is_arg(argv[i], "verbose")) {
+            verbose = true;
+        } else {
+            printf("Unknown arg %s\n", argv[i]);
+            printf("usage: %s [--trials N] [--seed S] [--kind NAME] [--timeout SEC] [--verbose]\n",
+                   argv[0]);
+            return -1;
+        }
+    }
+
+    int only = -1;
+    if (kindName) {
+        for (int k = 0; k < kKindCount; ++k) {
+            if (!strcmp(kindName, gKinds[k].name)) {
+                only = k;
+            }
+        }
+        if (only < 0) {
+            printf("Unknown kind %s\n", kindName);
+            return -1;
+        }
+    }
+
+    int problems = 0;
+    for (int t = 0; t < trials; ++t) {
+        const uint32_t s = seed + t;
+        const FuzzKind& kind = gKinds[only >= 0 ? only : s % kKindCount];
+
+        int segments = 0;
+        std::vector<double> times;
+        std::string death = run_child(timeout, [&]() {
+            GRandom rand(s);
+            FuzzInput input;
+            kind.make(rand, pick_count(rand), &input);
+            return std::vector<double>{ (double)input.segments, time_draw(input, 1) };
+        }, &times);
+        if (times.size() == 2) {
+            segments = (int)times[0];
+        }
+
+        std::string problem = death;
+        if (death.empty() && times.size() == 2) {
+            double budget = kBudgetMS + kBudgetMSPerSegment * segments;
+            if (times[1] > budget) {
+                char msg[100];
+                snprintf(msg, sizeof(msg), "SLOW %.1f ms (budget %.1f)", times[1], budget);
+                problem = msg;
+            }
+        }
+        if (!problem.empty()) {
+            problems += 1;
+            printf("%s: %s [seed %u]: %s\n", kind.name,
+                   segments ? std::to_string(segments).c_str() : "?", s, problem.c_str());
+            printf("    repro: %s --kind %s --seed %u --trials 1\n", argv[0], kind.name, s);
+        } else if (verbose) {
+            printf("%s: %d [seed %u]: %.2f ms\n", kind.name, segments, s, times[1]);
+        }
+    }
+
+    // time against size: linear is an exponent of 1, and sorting the edges adds a little
+    for (int k = 0; k < kKindCount; ++k) {
+        if (only >= 0 && k != only) {
+            continue;
+        }
+        std::vector<double> times;
+        std::string death = run_child(timeout * 4, [&]() {
+            std::vector<double> result;
+            for (int n : { 10000, 100000 }) {
+                GRandom rand(seed);
+                FuzzInput input;
+                gKinds[k].make(rand, n, &input);
+                result.push_back(time_draw(input, 3));
+            }
+            return result;
+        }, &times);
+
+        if (!death.empty() || times.size() != 2) {
+            problems += 1;
+            printf("%s scaling [seed %u]: %s\n", gKinds[k].name, seed, death.c_str());
+            continue;
+        }
+        double exponent = log(std::max(times[1], 1e-3) / std::max(times[0], 1e-3)) / log(10.0);
+        bool superlinear = exponent > 1.5 && times[1] > 10;
+        if (superlinear) {
+            problems += 1;
+        }
+        if (superlinear || verbose) {
+            printf("%s scaling [seed %u]: 10^4 %.2f ms, 10^5 %.2f ms, n^%.2f%s\n", gKinds[k].name,
+                   seed, times[0], times[1], exponent, superlinear ? " SUPERLINEAR" : "");
+        }
+    }
+
+    printf("fuzz: %d trials, %d problems\n", trials, problems);
+    return problems ? 1 : 0;
+}
@@ -0,0 +1,223 @@
+#ifndef _fuzz_scene_h_DEFINED
+#define _fuzz_scene_h_DEFINED
+
+#include "../include/GBitmap.h"
+#include "../include/GCanvas.h"
+#include "../include/GMatrix.h"
+#include "../include/GPaint.h"
+#include "../include/GPath.h"
+#include "../include/GRandom.h"
+#include "../include/GShader.h"
+#include <math.h>
+#include <memory>
+#include <vector>
+
+/**
+ *  Random scenes for differential tests (see image --reference): every call, paint, shader and
+ *  matrix is picked with a GRandom, so a seed always reproduces the same scene. The texture is
+ *  generated rather than loaded, so scenes need no files.
+ */
+class FuzzScene {
+public:
+    FuzzScene(GISize size, uint32_t seed) : fSize(size), fRand(seed) {
+        fTexture.alloc(32, 32);
+        for (int y = 0; y < 32; ++y) {
+            for (int x = 0; x < 32; ++x) {
+                unsigned a = (x ^ y) & 16 ? 255 : 128 + 4 * x;
+                *fTexture.getAddr(x, y) = GPixel_PackARGB(a, (8 * x) * a / 255, (8 * y) * a / 255,
+                                                          ((x + y) * 4) * a / 255);
+            }
+        }
+    }
+    ~FuzzScene() { free(fTexture.pixels()); }
+
+    void draw(GCanvas* canvas, int ops) {
+        int depth = 0;
+        for (int i = 0; i < ops; ++i) {
+            switch (fRand.nextRange(0, 11)) {
+                case 0: canvas->drawRect(this->rect(), this->paint()); break;
+                case 1: this->drawPolygon(canvas); break;
+                case 2: canvas->drawPath(this->path(), this->paint()); break;
+                case 3: this->drawPolyline(canvas); break;
+                case 4: this->drawMesh(canvas); break;
+                case 5: this->drawQuad(canvas); break;
+                case 6:
+                    canvas->save();
+                    canvas->concat(this->matrix());
+                    depth += 1;
+                    break;
+                case 7: canvas->clipRect(this->rect()); break;
+                case 8:
+                    canvas->save();
+                    canvas->clipPath(this->path());
+                    depth += 1;
+                    break;
+                case 9: {
+                    GRect bounds = this->rect();
+                    GPaint paint({0, 0, 0, this->alpha()});
+                    canvas->saveLayer(fRand.nextRange(0, 1) ? &bounds : nullptr, paint);
+                    depth += 1;
+                } break;
+                case 10:
+                    if (depth > 0) {
+                        canvas->restore();
+                        depth -= 1;
+                    }
+                    break;
+                case 11: canvas->clear(this->color()); break;
+            }
+            // shaders only have to live until their draw is done
+            fShaders.clear();
+        }
+        while (depth-- > 0) {
+            canvas->restore();
+        }
+    }
+
+private:
+    GISize                                fSize;
+    GRandom                               fRand;
+    GBitmap                               fTexture;
+    std::vector<std::unique_ptr<GShader>> fShaders;
+
+    float unit() { return fRand.nextF(); }
+    float coord(float extent) { return (this->unit() * 1.5f - 0.25f) * extent; }
+    GPoint point() { return { this->coord((float)fSize.width), this->coord((float)fSize.height) }; }
+
+    GRect rect() {
+        GPoint a = this->point(), b = this->point();
+        return GRect::LTRB(std::min(a.x, b.x), std::min(a.y, b.y),
+                           std::max(a.x, b.x), std::max(a.y, b.y));
+    }
+
+    // opaque, clear and in between are all special-cased somewhere
+    float alpha() {
+        switch (fRand.nextRange(0, 3)) {
+            case 0: return 1;
+            case 1: return 0;
+            default: return this->unit();
+        }
+    }
+
+    GColor color() {
+        return { this->unit(), this->unit(), this->unit(), this->alpha() };
+    }
+
+    GMatrix matrix() {
+        switch (fRand.nextRange(0, 2)) {
+            case 0: return GMatrix::Translate(this->coord(50), this->coord(50));
+            case 1: return GMatrix::Scale(this->unit() * 2 + 0.1f, this->unit() * 2 + 0.1f);
+            default: {
+                float cx = fSize.width * 0.5f, cy = fSize.height * 0.5f;
+                return GMatrix::Translate(cx, cy) * GMatrix::Rotate(this->unit() * 6.28f) *
+                       GMatrix::Translate(-cx, -cy);
+            }
+        }
+    }
+
+    GShader* shader() {
+        const GTileMode modes[] = { GTileMode::kClamp, GTileMode::kRepeat, GTileMode::kMirror };
+        GTileMode mode = modes[fRand.nextRange(0, 2)];
+
+        if (fRand.nextRange(0, 1)) {
+            GColor colors[4];
+            int count = fRand.nextRange(1, 4);
+            for (int i = 0; i < count; ++i) {
+                colors[i] = this->color();
+            }
+            fShaders.push_back(GCreateLinearGradient(this->point(), this->point(), colors, count,
+                                                     mode));
+        } else {
+            GMatrix local = GMatrix::Translate(this->coord(100), this->coord(100)) *
+                            GMatrix::Rotate(this->unit() * 6.28f) *
+                            GMatrix::Scale(this->unit() * 4 + 0.25f, this->unit() * 4 + 0.25f);
+            fShaders.push_back(GCreateBitmapShader(fTexture, local, mode));
+        }
+        return fShaders.back().get();
+    }
+
+    GPaint paint(bool needsShader = false) {
+        GPaint paint(this->color());
+        if (needsShader || fRand.nextRange(0, 2) == 0) {
+            paint.setShader(this->shader());
+        }
+        paint.setBlendMode((GBlendMode)fRand.nextRange(0, (int)GBlendMode::kXor));
+        return paint;
+    }
+
+    GPath path() {
+        GPath path;
+        int contours = fRand.nextRange(1, 4);
+        for (int c = 0; c < contours; ++c) {
+            path.moveTo(this->point());
+            int verbs = fRand.nextRange(1, 8);
+            for (int v = 0; v < verbs; ++v) {
+                switch (fRand.nextRange(0, 2)) {
+                    case 0: path.lineTo(this->point()); break;
+                    case 1: path.quadTo(this->point(), this->point()); break;
+                    case 2: path.cubicTo(this->point(), this->point(), this->point()); break;
+                }
+            }
+        }
+        path.setFillType((GPath::FillType)fRand.nextRange(0, 3));
+        return path;
+    }
+
+    void drawPolygon(GCanvas* canvas) {
+        // a regular polygon is always convex
+        GPoint center = this->point();
+        float radius = this->unit() * fSize.width * 0.5f;
+        float start = this->unit() * 6.28f;
+        int count = fRand.nextRange(3, 12);
+
+        GPoint pts[12];
+        for (int i = 0; i < count; ++i) {
+            float angle = start + i * 6.2831853f / count;
+            pts[i] = { center.x + radius * cosf(angle), center.y + radius * sinf(angle) };
+        }
+        canvas->drawConvexPolygon(pts, count, this->paint());
+    }
+
+    void drawPolyline(GCanvas* canvas) {
+        GPoint pts[8];
+        int count = fRand.nextRange(2, 8);
+        for (int i = 0; i < count; ++i) {
+            pts[i] = this->point();
+        }
+        canvas->drawPolyline(pts, count, this->paint());
+    }
+
+    void drawMesh(GCanvas* canvas) {
+        GPoint verts[8], texs[8];
+        GColor colors[8];
+        for (int i = 0; i < 8; ++i) {
+            verts[i] = this->point();
+            texs[i] = { this->unit() * 32, this->unit() * 32 };
+            colors[i] = this->color();
+        }
+        int indices[12];
+        for (int& index : indices) {
+            index = fRand.nextRange(0, 7);
+        }
+
+        // texture coordinates need a shader to look up
+        bool useColors = fRand.nextRange(0, 1), useTexs = !useColors || fRand.nextRange(0, 1);
+        canvas->drawMesh(verts, useColors ? colors : nullptr, useTexs ? texs : nullptr, 4, indices,
+                         this->paint(useTexs));
+    }
+
+    void drawQuad(GCanvas* canvas) {
+        GPoint verts[4], texs[4];
+        GColor colors[4];
+        for (int i = 0; i < 4; ++i) {
+            verts[i] = this->point();
+            texs[i] = { this->unit() * 32, this->unit() * 32 };
+            colors[i] = this->color();
+        }
+        bool useColors = fRand.nextRange(0, 1), useTexs = !useColors || fRand.nextRange(0, 1);
+        canvas->drawQuad(verts, useColors ? colors : nullptr, useTexs ? texs : nullptr,
+                         fRand.nextRange(0, 4), this->paint(useTexs));
+    }
+};
+
+#endif
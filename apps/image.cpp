@@ -6,7 +6,14 @@
 #include "../include/GCanvas.h"
 #include "../include/GColor.h"
 #include "../include/GBitmap.h"
+#include "../include/GReference.h"
+#include "../include/GTrace.h"
+#include "fuzz_scene.h"
+#include <atomic>
 #include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
 
 static int pixel_diff(GPixel p0, GPixel p1) {
     int da = abs(GPixel_GetA(p0) - GPixel_GetA(p1));
@@ -46,7 +53,8 @@ static double compare(const GBitmap& a, const GBitmap& b, int tolerance, bool ve
         rowB = (const GPixel*)((const char*)rowB + b.rowBytes());
     }
 
-    double score = 1.0 * (total - total_diff) / total;
+    // two fully transparent images match
+    double score = total ? 1.0 * (total - total_diff) / total : 1;
     assert(score >= 0 && score <= 1);
     score *= score;
     if (verbose) {
@@ -57,21 +65,143 @@ static double compare(const GBitmap& a, const GBitmap& b, int tolerance, bool ve
 
 /////////////////////////////////////////////////////////////////////////////////////////////////
 
-static void handle_proc(const GDrawRec& rec, const char path[], GBitmap* bitmap) {
+static bool draw_rec(const GDrawRec& rec, GBitmap* bitmap, const char* traceDir) {
     bitmap->alloc(rec.fWidth, rec.fHeight);
 
     auto canvas = GCreateCanvas(*bitmap);
     if (!canvas) {
         fprintf(stderr, "failed to create canvas for [%d %d] %s\n",
                 rec.fWidth, rec.fHeight, rec.fName);
-        return;
+        return false;
     }
 
     canvas->clear({0, 0, 0, 0});
+    if (traceDir) {
+        // record the calls as they draw, for bench --trace
+        std::string path = std::string(traceDir) + "/" + rec.fName + ".gtrace";
+        auto tracer = GCreateTraceCanvas(path.c_str(), {rec.fWidth, rec.fHeight}, canvas.get());
+        if (tracer) {
+            rec.fDraw(tracer.get());
+            return true;
+        }
+        fprintf(stderr, "failed to create %s\n", path.c_str());
+    }
     rec.fDraw(canvas.get());
+    return true;
+}
 
-    if (!bitmap->writeToFile(path)) {
-        fprintf(stderr, "failed to write %s\n", path);
+// FNV-1a of the file's bytes, or false if it can't be read
+static bool hash_file(const char path[], uint64_t* hash) {
+    FILE* f = fopen(path, "rb");
+    if (!f) {
+        return false;
+    }
+    uint64_t h = 0xcbf29ce484222325ull;
+    unsigned char buffer[1 << 16];
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), f)) > 0) {
+        for (size_t i = 0; i < n; ++i) {
+            h = (h ^ buffer[i]) * 0x100000001b3ull;
+        }
+    }
+    bool ok = !ferror(f);
+    fclose(f);
+    *hash = h;
+    return ok;
+}
+
+/**
+ *  Load an expected image. With a cache directory, its decoded pixels are kept there as a raw
+ *  file (see GBitmap::writeToRawFile) named for a hash of the png's bytes: mapping that costs
+ *  nothing, where decoding the png is most of what a record costs. Keying on the contents (not
+ *  the mtime) means a png restored with an old date (cp -p, tar, git checkout) is never matched
+ *  with a stale copy. A cache that can't be written only means we decode again next time.
+ */
+static bool load_expected(const std::string& pngPath, const char* cacheDir, GBitmap* bm,
+                          bool* mapped) {
+    *mapped = false;
+
+    std::string rawPath;
+    uint64_t hash;
+    if (cacheDir && hash_file(pngPath.c_str(), &hash)) {
+        char name[32];
+        snprintf(name, sizeof(name), "/%016llx.graw", (unsigned long long)hash);
+        rawPath = std::string(cacheDir) + name;
+        if (bm->mapFromFile(rawPath.c_str())) {
+            *mapped = true;
+            return true;
+        }
+    }
+
+    if (!bm->readFromFile(pngPath.c_str())) {
+        return false;
+    }
+    if (!rawPath.empty()) {
+        // write under another name first, so a concurrent run never maps half a file
+        std::string tmpPath = rawPath + "." + std::to_string(getpid()) + ".tmp";
+        if (bm->writeToRawFile(tmpPath.c_str())) {
+            rename(tmpPath.c_str(), rawPath.c_str());
+        } else {
+            remove(tmpPath.c_str());
+        }
+    }
+    return true;
+}
+
+// One record, drawn and scored by whichever worker thread picks it up.
+struct RecTask {
+    const GDrawRec* rec;
+    std::string     path;           // where its png goes, if it is written
+    bool            something;      // not scored
+    GBitmap         test;
+    GBitmap         expected;
+    bool            expectedLoaded = false;
+    bool            expectedMapped = false;
+    double          score = 0;
+};
+
+/**
+ *  Draw the tasks on [threads] threads, comparing each against its expected image in memory.
+ *  A png is only encoded when [writeAll] is set, or for a record that fails its comparison;
+ *  its rows are only encoded in parallel when the tasks aren't.
+ */
+static void run_tasks(std::vector<RecTask>& tasks, int threads, const char* expected,
+                      const char* cacheDir, int tolerance, bool writeAll, const char* traceDir) {
+    threads = std::max(1, std::min(threads, (int)tasks.size()));
+    const int encodeThreads = threads > 1 ? 1 : 0;
+
+    std::atomic<size_t> next(0);
+    auto worker = [&]() {
+        for (size_t i; (i = next.fetch_add(1)) < tasks.size();) {
+            RecTask& task = tasks[i];
+            if (!draw_rec(*task.rec, &task.test, traceDir)) {
+                continue;
+            }
+            bool failed = false;
+            if (expected && !task.something) {
+                std::string path = std::string(expected) + "/" + task.rec->fName + ".png";
+                task.expectedLoaded = load_expected(path, cacheDir, &task.expected,
+                                                    &task.expectedMapped);
+                if (task.expectedLoaded) {
+                    task.score = compare(task.test, task.expected, tolerance, false);
+                }
+                failed = task.score < 1;
+            }
+            if ((writeAll || failed) &&
+                !task.test.writeToFile(task.path.c_str(), GBitmap::kDefault_PNGLevel,
+                                       encodeThreads)) {
+                fprintf(stderr, "failed to write %s\n", task.path.c_str());
+            }
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (int t = 1; t < threads; ++t) {
+        workers.emplace_back(worker);
+    }
+    worker();
+    for (std::thread& w : workers) {
+        w.join();
     }
 }
 
@@ -165,6 +295,65 @@ static void handle_something(FILE* f, std::string prefix, const char dir[], int
     }
 }
 
+/////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ *  Differential test: draw with the fast paths, and again in reference mode (see GReference.h),
+ *  and compare the two. draw() is called once per mode with a fresh, cleared canvas. Returns
+ *  true if every pixel is within tolerance; otherwise prints the score, and adds both images to
+ *  the diff page if there is one.
+ */
+template <typename Draw>
+static bool check_reference(const char name[], int w, int h, int tolerance, Draw draw,
+                            FILE* diffFile, const char diffDir[]) {
+    GBitmap fast, ref;
+    for (GBitmap* bm : { &fast, &ref }) {
+        bm->alloc(w, h);
+        auto canvas = GCreateCanvas(*bm);
+        canvas->clear({0, 0, 0, 0});
+
+        GSetReferenceMode(bm == &ref);
+        draw(canvas.get());
+        GSetReferenceMode(false);
+    }
+
+    double score = compare(fast, ref, tolerance, false);
+    if (score < 1) {
+        printf("reference: %s differs (%d%%)\n", name, (int)(score * 100));
+        if (diffFile) {
+            add_diff_to_file(diffFile, fast, ref, diffDir, name);
+        }
+    }
+    free(fast.pixels());
+    free(ref.pixels());
+    return score == 1;
+}
+
+static int handle_reference(const char* match, int tolerance, int fuzzCount,
+                            FILE* diffFile, const char diffDir[]) {
+    int count = 0, failed = 0;
+    for (int i = 0; gDrawRecs[i].fDraw; ++i) {
+        const GDrawRec& rec = gDrawRecs[i];
+        if (match && !strstr(rec.fName, match)) {
+            continue;
+        }
+        count += 1;
+        failed += !check_reference(rec.fName, rec.fWidth, rec.fHeight, tolerance, rec.fDraw,
+                                   diffFile, diffDir);
+    }
+
+    for (int seed = 1; seed <= fuzzCount; ++seed) {
+        std::string name = "fuzz_" + std::to_string(seed);
+        count += 1;
+        failed += !check_reference(name.c_str(), 256, 256, tolerance, [seed](GCanvas* canvas) {
+            FuzzScene({256, 256}, seed).draw(canvas, 40);
+        }, diffFile, diffDir);
+    }
+
+    printf("       reference: %d/%d match\n", count - failed, count);
+    return failed ? 1 : 0;
+}
+
 static int gPACounts[10] = { 0,0,0,0,0,0,0,0,0,0 };
 static int gDrawCount;
 
@@ -196,9 +385,16 @@ int main_image(int argc, const char* argv[]) {
     const char* expected = NULL;
     const char* diffDir = NULL;
     const char* scoreFile = nullptr;
+    const char* traceDir = nullptr;
+    const char* cacheDir = nullptr;     // where decoded expected images are kept (--cache)
     FILE* diffFile = NULL;
     int tolerance = 0;
     bool append_pa_prefix = true;
+    bool writeAll = false;
+    int threads = std::max(1u, std::thread::hardware_concurrency());
+
+    bool reference = false;
+    int fuzzCount = 100;
 
     const char* collage_dir = nullptr;
     int collage_index = -1;
@@ -215,11 +411,14 @@ int main_image(int argc, const char* argv[]) {
             verbose = true;
         } else if (is_arg(argv[i], "write") && i+1 < argc) {
             append_pa_prefix = false;
+            writeAll = true;
             root = argv[++i];
         } else if (is_arg(argv[i], "match") && i+1 < argc) {
             match = argv[++i];
         } else if (is_arg(argv[i], "expected") && i+1 < argc) {
             expected = argv[++i];
+        } else if (is_arg(argv[i], "cache") && i+1 < argc) {
+            cacheDir = argv[++i];
         } else if (is_arg(argv[i], "tolerance") && i+1 < argc) {
             tolerance = atoi(argv[++i]);
             assert(tolerance >= 0);
@@ -235,6 +434,16 @@ int main_image(int argc, const char* argv[]) {
             } else {
                 fprintf(diffFile, "<h3>Test Orig Diff DIFF</h3>\n");
             }
+        } else if (is_arg(argv[i], "trace") && i+1 < argc) {
+            traceDir = argv[++i];
+        } else if (is_arg(argv[i], "png")) {
+            writeAll = true;
+        } else if (is_arg(argv[i], "threads") && i+1 < argc) {
+            threads = std::max(1, atoi(argv[++i]));
+        } else if (is_arg(argv[i], "reference")) {
+            reference = true;
+        } else if (is_arg(argv[i], "fuzz") && i+1 < argc) {
+            fuzzCount = atoi(argv[++i]);
         } else if (is_arg(argv[i], "collage") && i+2 < argc) {
             collage_dir = argv[++i];
             collage_index = atol(argv[++i]);
@@ -249,6 +458,14 @@ int main_image(int argc, const char* argv[]) {
         }
     }
 
+    if (reference) {
+        int result = handle_reference(match, tolerance, fuzzCount, diffFile, diffDir);
+        if (diffFile) {
+            fclose(diffFile);
+        }
+        return result;
+    }
+
     if (!match) {
         auto prefix = make_image_prefix(max_pa_num());
         handle_something(collage_file, prefix, collage_dir, collage_index);
@@ -257,8 +474,15 @@ int main_image(int argc, const char* argv[]) {
     // pa#_NAME.png -- so add 8 to the name length for the total
     const int maxNameLen = max_name_len() + 8;
 
+    // with nothing to compare against, the pngs are the only output
+    if (!expected) {
+        writeAll = true;
+    }
+
     double percent_correct = 0;
     double counter = 0;
+    std::vector<RecTask> tasks;
+    std::vector<double> weights;
     for (int i = 0; gDrawRecs[i].fDraw; ++i) {
         double weight = 1 << (gDrawRecs[i].fPA - 1);
         weight /= gPACounts[gDrawRecs[i].fPA];
@@ -280,38 +504,44 @@ int main_image(int argc, const char* argv[]) {
             continue;
         }
 
-        if (verbose && !something) {
-            printf("image: [%2d] %*s", i, maxNameLen, path.c_str());
-        }
-        
-        GBitmap testBM;
-        handle_proc(gDrawRecs[i], path.c_str(), &testBM);
-
-        if (expected && !something) {
-            std::string exp_path(expected);
-            exp_path += "/";
-            exp_path += gDrawRecs[i].fName;
-            exp_path += ".png";
-            GBitmap expectedBM;
-    
-            if (!expectedBM.readFromFile(exp_path.c_str())) {
-                printf("- failed to load <%s>", exp_path.c_str());
-            } else {
-                double correct = compare(testBM, expectedBM, tolerance, verbose);
-                if (correct < 1 && diffFile != NULL) {
-                    add_diff_to_file(diffFile, testBM, expectedBM, diffDir, gDrawRecs[i].fName);
-                }
-                double individual_score = correct * weight;
+        tasks.emplace_back();
+        tasks.back().rec = &gDrawRecs[i];
+        tasks.back().path = path;
+        tasks.back().something = something;
+        weights.push_back(weight);
+    }
+
+    run_tasks(tasks, threads, expected, cacheDir, tolerance, writeAll, traceDir);
 
-                percent_correct += individual_score;
+    // report in record order, whatever order the threads finished in
+    for (size_t t = 0; t < tasks.size(); ++t) {
+        RecTask& task = tasks[t];
+        const bool scored = expected && !task.something;
+
+        if (verbose && !task.something) {
+            printf("image: [%2d] %*s", (int)(task.rec - gDrawRecs), maxNameLen, task.path.c_str());
+        }
+        if (scored && !task.expectedLoaded) {
+            printf("- failed to load <%s/%s.png>", expected, task.rec->fName);
+        } else if (scored) {
+            if (verbose) {
+                printf("  %3d", (int)(task.score * 100));
             }
+            if (task.score < 1 && diffFile != NULL) {
+                add_diff_to_file(diffFile, task.test, task.expected, diffDir, task.rec->fName);
+            }
+            percent_correct += task.score * weights[t];
         }
-
-        if (verbose && !something) {
+        if (verbose && !task.something) {
             printf("\n");
         }
 
-        free(testBM.pixels());
+        free(task.test.pixels());
+        if (task.expectedMapped) {
+            task.expected.unmapFile();
+        } else {
+            free(task.expected.pixels());
+        }
     }
     if (diffFile) {
         fclose(diffFile);
@@ -0,0 +1,42 @@
+/**
+ *  Converts PNGs into the raw pixel container read by GBitmap::mapFromFile().
+ *
+ *  usage: png2raw file.png ...    (writes file.graw next to each input)
+ */
+
+#include "../include/GBitmap.h"
+#include <stdio.h>
+#include <string>
+
+int main(int argc, const char* argv[]) {
+    if (argc < 2) {
+        printf("usage: %s file.png ...\n", argv[0]);
+        return -1;
+    }
+
+    int failures = 0;
+    for (int i = 1; i < argc; ++i) {
+        std::string out(argv[i]);
+        size_t dot = out.rfind('.');
+        if (dot != std::string::npos && out.find('/', dot) == std::string::npos) {
+            out.erase(dot);
+        }
+        out += ".graw";
+
+        GBitmap bm;
+        if (!bm.readFromFile(argv[i])) {
+            printf("failed to read %s\n", argv[i]);
+            failures += 1;
+            continue;
+        }
+        if (!bm.writeToRawFile(out.c_str())) {
+            printf("failed to write %s\n", out.c_str());
+            failures += 1;
+        } else {
+            printf("%s -> %s [%d %d]%s\n", argv[i], out.c_str(), bm.width(), bm.height(),
+                   bm.isOpaque() ? " opaque" : "");
+        }
+        free(bm.pixels());
+    }
+    return failures ? -1 : 0;
+}
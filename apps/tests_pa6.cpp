@@ -0,0 +1,890 @@
+#include "../include/GPath.h"
+#include "../include/GCanvas.h"
+#include "../include/GPicture.h"
+#include "../include/GPNGWriter.h"
+#include "../include/GBitmap.h"
+#include "../include/GPixelF.h"
+#include "../include/GPixelCompact.h"
+#include "../include/GReference.h"
+#include "../include/GShader.h"
+#include "../include/GTrace.h"
+#include "fuzz_scene.h"
+#include "tests.h"
+#include <stdio.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static GPixel pixel_at(const GBitmap& bm, int x, int y) {
+    return *bm.getAddr(x, y);
+}
+
+static void test_path_filltype(GTestStats* stats) {
+    const GPixel white = GPixel_PackARGB(0xFF, 0xFF, 0xFF, 0xFF);
+
+    // two nested rects wound the same way: the inner one is a hole only for even-odd
+    GPath path;
+    path.addRect(GRect::LTRB(0, 0, 10, 10));
+    path.addRect(GRect::LTRB(3, 3, 7, 7));
+    EXPECT_EQ(stats, path.getFillType(), GPath::kWinding_FillType);
+
+    const struct {
+        GPath::FillType type;
+        GPixel          outer, inner, outside;
+    } rec[] = {
+        { GPath::kWinding_FillType,        white, white, 0     },
+        { GPath::kEvenOdd_FillType,        white, 0,     0     },
+        { GPath::kInverseWinding_FillType, 0,     0,     white },
+        { GPath::kInverseEvenOdd_FillType, 0,     white, white },
+    };
+
+    for (const auto& r : rec) {
+        GBitmap bm;
+        bm.alloc(12, 12);
+        auto canvas = GCreateCanvas(bm);
+
+        path.setFillType(r.type);
+        canvas->drawPath(path, GPaint({1, 1, 1, 1}));
+
+        EXPECT_EQ(stats, pixel_at(bm, 1, 1), r.outer);
+        EXPECT_EQ(stats, pixel_at(bm, 5, 5), r.inner);
+        EXPECT_EQ(stats, pixel_at(bm, 11, 11), r.outside);
+        free(bm.pixels());
+    }
+
+    GPath copy = path;
+    EXPECT_EQ(stats, copy.getFillType(), GPath::kInverseEvenOdd_FillType);
+    path.reset();
+    EXPECT_EQ(stats, path.getFillType(), GPath::kWinding_FillType);
+
+    // an empty inverse path covers everything
+    GBitmap bm;
+    bm.alloc(4, 4);
+    auto canvas = GCreateCanvas(bm);
+    path.setFillType(GPath::kInverseWinding_FillType);
+    canvas->drawPath(path, GPaint({1, 1, 1, 1}));
+    EXPECT_TRUE(stats, expect_pixels_value(bm, white));
+    free(bm.pixels());
+}
+
+// A curve whose control point is far out (but finite) still closes its contour: it covers
+// everything to the right of x = 10 between its ends, however far out the point is.
+static void test_path_giant_curve(GTestStats* stats) {
+    for (float cx : { 3e19f, 1e20f, 1e30f, 3e38f }) {
+        for (bool cubic : { false, true }) {
+            GPath path;
+            path.moveTo(10, 10);
+            if (cubic) {
+                path.cubicTo({cx, 30}, {cx, 70}, {10, 90});
+            } else {
+                path.quadTo({cx, 50}, {10, 90});
+            }
+
+            GBitmap bm;
+            bm.alloc(100, 100);
+            GCreateCanvas(bm)->drawPath(path, GPaint({1, 1, 1, 1}));
+
+            int drawn = 0;
+            for (int y = 0; y < 100; ++y) {
+                for (int x = 0; x < 100; ++x) {
+                    drawn += pixel_at(bm, x, y) != 0;
+                }
+            }
+            EXPECT_EQ(stats, drawn, 90 * 80);
+            free(bm.pixels());
+        }
+    }
+}
+
+static void test_path_stroke(GTestStats* stats) {
+    const GPixel white = GPixel_PackARGB(0xFF, 0xFF, 0xFF, 0xFF);
+
+    GPath line;
+    line.moveTo(4, 10);
+    line.lineTo(16, 10);
+
+    EXPECT_EQ(stats, line.stroke(0).countPoints(), 0);
+
+    const struct {
+        GPath::CapType cap;
+        GPixel         beyondEnd;
+    } rec[] = {
+        { GPath::kButt_CapType,   0     },
+        { GPath::kSquare_CapType, white },
+        { GPath::kRound_CapType,  white },
+    };
+
+    for (const auto& r : rec) {
+        GBitmap bm;
+        bm.alloc(20, 20);
+        auto canvas = GCreateCanvas(bm);
+        canvas->drawPath(line.stroke(6, r.cap), GPaint({1, 1, 1, 1}));
+
+        EXPECT_EQ(stats, pixel_at(bm, 10, 10), white);
+        EXPECT_EQ(stats, pixel_at(bm, 10, 7), white);
+        EXPECT_EQ(stats, pixel_at(bm, 10, 13), 0u);
+        EXPECT_EQ(stats, pixel_at(bm, 17, 10), r.beyondEnd);
+        free(bm.pixels());
+    }
+
+    // the corner of a polyline is joined, and overlapping pieces are filled only once
+    GPath corner;
+    corner.moveTo(4, 4);
+    corner.lineTo(14, 4);
+    corner.lineTo(14, 14);
+
+    GBitmap bm;
+    bm.alloc(20, 20);
+    auto canvas = GCreateCanvas(bm);
+    canvas->drawPath(corner.stroke(4, GPath::kButt_CapType, GPath::kMiter_JoinType),
+                     GPaint({1, 1, 1, 0.5f}));
+    EXPECT_EQ(stats, pixel_at(bm, 15, 3), GPixel_PackARGB(0x80, 0x80, 0x80, 0x80));
+    EXPECT_EQ(stats, pixel_at(bm, 14, 4), GPixel_PackARGB(0x80, 0x80, 0x80, 0x80));
+
+    // a round join only rounds the outside of the corner, and is filled once too
+    canvas->clear({0, 0, 0, 0});
+    canvas->drawPath(corner.stroke(4, GPath::kButt_CapType, GPath::kRound_JoinType),
+                     GPaint({1, 1, 1, 0.5f}));
+    EXPECT_EQ(stats, pixel_at(bm, 15, 3), GPixel_PackARGB(0x80, 0x80, 0x80, 0x80));
+    EXPECT_EQ(stats, pixel_at(bm, 13, 5), GPixel_PackARGB(0x80, 0x80, 0x80, 0x80));
+    EXPECT_EQ(stats, pixel_at(bm, 16, 2), 0u);
+
+    // turning straight back, it rounds the end the pieces meet at
+    GPath back;
+    back.moveTo(4, 10);
+    back.lineTo(14, 10);
+    back.lineTo(8, 10);
+    canvas->clear({0, 0, 0, 0});
+    canvas->drawPath(back.stroke(6, GPath::kButt_CapType, GPath::kRound_JoinType),
+                     GPaint({1, 1, 1, 1}));
+    EXPECT_EQ(stats, pixel_at(bm, 16, 10), white);
+    EXPECT_EQ(stats, pixel_at(bm, 3, 10), 0u);
+
+    // a contour with no length is a dot with round caps, a square with square ones
+    GPath dot;
+    dot.moveTo(10.5f, 10.5f);
+    dot.lineTo(10.5f, 10.5f);
+    EXPECT_EQ(stats, dot.stroke(6, GPath::kButt_CapType).countPoints(), 0);
+    for (auto cap : { GPath::kRound_CapType, GPath::kSquare_CapType }) {
+        canvas->clear({0, 0, 0, 0});
+        canvas->drawPath(dot.stroke(6, cap), GPaint({1, 1, 1, 1}));
+        EXPECT_EQ(stats, pixel_at(bm, 10, 10), white);
+        EXPECT_EQ(stats, pixel_at(bm, 12, 8), white);
+        EXPECT_EQ(stats, pixel_at(bm, 13, 13), cap == GPath::kSquare_CapType ? white : 0u);
+        EXPECT_EQ(stats, pixel_at(bm, 14, 10), 0u);
+    }
+    free(bm.pixels());
+}
+
+static int count_nonzero_pixels(const GBitmap& bm) {
+    int n = 0;
+    visit_pixels(bm, [&](int x, int y, GPixel* p) {
+        n += *p != 0;
+    });
+    return n;
+}
+
+static void test_big_device(GTestStats* stats) {
+    // edges step in fixed point; devices past 32767 pixels on a side must not overflow it
+    const GISize sizes[] = { {4, 40000}, {40000, 4} };
+    for (GISize size : sizes) {
+        GBitmap bm;
+        bm.alloc(size.width, size.height);
+        auto canvas = GCreateCanvas(bm);
+        const GRect bounds = GRect::WH(size.width, size.height);
+
+        canvas->drawRect(bounds, GPaint({1, 1, 1, 1}));
+        EXPECT_EQ(stats, count_nonzero_pixels(bm), size.width * size.height);
+
+        canvas->clear({0, 0, 0, 0});
+        GPath path;
+        path.addRect(bounds);
+        canvas->drawPath(path, GPaint({1, 1, 1, 1}));
+        EXPECT_EQ(stats, count_nonzero_pixels(bm), size.width * size.height);
+
+        // a hairline across the short side, far along the long one
+        canvas->clear({0, 0, 0, 0});
+        const float far = 39000.5f;
+        const bool wide = size.width > size.height;
+        canvas->drawLine(wide ? GPoint{far, 0} : GPoint{0, far},
+                         wide ? GPoint{far, 4} : GPoint{4, far}, GPaint({1, 1, 1, 1}));
+        EXPECT_EQ(stats, count_nonzero_pixels(bm), 4);
+        EXPECT_TRUE(stats, pixel_at(bm, wide ? 39000 : 2, wide ? 2 : 39000) != 0);
+
+        free(bm.pixels());
+    }
+}
+
+static void test_hairline(GTestStats* stats) {
+    const GPixel white = GPixel_PackARGB(0xFF, 0xFF, 0xFF, 0xFF);
+    const GPaint paint({1, 1, 1, 1});
+
+    GBitmap bm;
+    bm.alloc(10, 10);
+    auto canvas = GCreateCanvas(bm);
+
+    // horizontal: pixels 2..7 on row 5, the end pixel is left for the next segment
+    canvas->drawLine({2, 5.5f}, {8, 5.5f}, paint);
+    EXPECT_EQ(stats, count_nonzero_pixels(bm), 6);
+    EXPECT_EQ(stats, pixel_at(bm, 2, 5), white);
+    EXPECT_EQ(stats, pixel_at(bm, 7, 5), white);
+    EXPECT_EQ(stats, pixel_at(bm, 8, 5), 0u);
+
+    // a diagonal polyline touches one pixel per column, and its shared vertex only once
+    canvas->clear({0, 0, 0, 0});
+    const GPoint pts[] = { {0, 0}, {5, 5}, {10, 0} };
+    canvas->drawPolyline(pts, 3, GPaint({1, 1, 1, 0.5f}));
+    EXPECT_EQ(stats, count_nonzero_pixels(bm), 10);
+    EXPECT_EQ(stats, pixel_at(bm, 5, 4), GPixel_PackARGB(0x80, 0x80, 0x80, 0x80));
+
+    // lines are clipped to the device, including ones that start and end far outside it
+    canvas->clear({0, 0, 0, 0});
+    canvas->drawLine({-1e6f, 3.5f}, {1e6f, 3.5f}, paint);
+    EXPECT_EQ(stats, count_nonzero_pixels(bm), 10);
+    canvas->drawLine({-20, -20}, {-5, 30}, paint);
+    EXPECT_EQ(stats, count_nonzero_pixels(bm), 10);
+    free(bm.pixels());
+}
+
+static void test_clip(GTestStats* stats) {
+    const GPixel white = GPixel_PackARGB(0xFF, 0xFF, 0xFF, 0xFF);
+    const GPaint paint({1, 1, 1, 1});
+
+    GBitmap bm;
+    bm.alloc(20, 20);
+    auto canvas = GCreateCanvas(bm);
+
+    // rect clips are mapped by the CTM and restored with it
+    canvas->save();
+    canvas->translate(5, 5);
+    canvas->clipRect(GRect::XYWH(0, 0, 5, 5));
+    canvas->drawRect(GRect::WH(20, 20), paint);
+    canvas->restore();
+    EXPECT_EQ(stats, count_nonzero_pixels(bm), 25);
+    EXPECT_EQ(stats, pixel_at(bm, 5, 5), white);
+    EXPECT_EQ(stats, pixel_at(bm, 10, 10), 0u);
+
+    canvas->drawRect(GRect::WH(20, 20), paint);
+    EXPECT_EQ(stats, count_nonzero_pixels(bm), 400);
+
+    // path clips intersect with the clip they are applied to, and limit clear() too
+    canvas->clear({0, 0, 0, 0});
+    GPath circle;
+    circle.addCircle({10, 10}, 6);
+
+    canvas->save();
+    canvas->clipPath(circle);
+    canvas->clipRect(GRect::LTRB(0, 0, 10, 20));
+    canvas->clear({1, 1, 1, 1});
+    canvas->restore();
+    EXPECT_EQ(stats, pixel_at(bm, 7, 10), white);
+    EXPECT_EQ(stats, pixel_at(bm, 12, 10), 0u);
+    EXPECT_EQ(stats, pixel_at(bm, 1, 1), 0u);
+
+    // a rotated rect clip becomes a mask; everything clipped out draws nothing
+    canvas->clear({0, 0, 0, 0});
+    canvas->save();
+    canvas->rotate(gFloatPI / 4);
+    canvas->clipRect(GRect::XYWH(0, -2, 30, 4));
+    canvas->drawLine({0, 0}, {0, 20}, paint);
+    canvas->drawRect(GRect::LTRB(-30, -30, 30, 30), paint);
+    canvas->clipRect(GRect::XYWH(0, 10, 5, 5));
+    canvas->drawRect(GRect::LTRB(-30, -30, 30, 30), GPaint({1, 0, 0, 1}));
+    canvas->restore();
+    EXPECT_EQ(stats, pixel_at(bm, 10, 10), white);
+    EXPECT_EQ(stats, pixel_at(bm, 10, 0), 0u);
+    EXPECT_EQ(stats, pixel_at(bm, 0, 10), 0u);
+    free(bm.pixels());
+}
+
+static void test_save_layer(GTestStats* stats) {
+    const GPaint paint({1, 1, 1, 1});
+
+    GBitmap bm;
+    bm.alloc(20, 20);
+    auto canvas = GCreateCanvas(bm);
+
+    // overlapping opaque shapes in a half-transparent layer come out as one uniform group
+    GPaint half;
+    half.setAlpha(0.5f);
+    canvas->saveLayer(nullptr, half);
+    canvas->drawRect(GRect::LTRB(0, 0, 10, 10), paint);
+    canvas->drawRect(GRect::LTRB(5, 5, 15, 15), paint);
+    canvas->restore();
+
+    const GPixel p = pixel_at(bm, 2, 2);
+    EXPECT_EQ(stats, (unsigned) GPixel_GetA(p), 0x80u);
+    EXPECT_EQ(stats, pixel_at(bm, 7, 7), p);
+    EXPECT_EQ(stats, pixel_at(bm, 12, 12), p);
+    EXPECT_EQ(stats, pixel_at(bm, 17, 17), 0u);
+
+    // the layer bounds are mapped by the CTM and limit what is composited
+    canvas->clear({0, 0, 0, 0});
+    canvas->save();
+    canvas->translate(10, 10);
+    const GRect bounds = GRect::WH(5, 5);
+    canvas->saveLayer(&bounds, GPaint());
+    canvas->drawRect(GRect::LTRB(-10, -10, 10, 10), paint);
+    canvas->restore();
+    canvas->restore();
+    EXPECT_EQ(stats, count_nonzero_pixels(bm), 25);
+    EXPECT_EQ(stats, pixel_at(bm, 10, 10), GPixel_PackARGB(0xFF, 0xFF, 0xFF, 0xFF));
+
+    // nested layers unwind in order, and a plain save inside a layer leaves it current
+    canvas->clear({0, 0, 0, 0});
+    canvas->saveLayer(nullptr, half);
+    canvas->save();
+    canvas->saveLayer(nullptr, half);
+    canvas->drawRect(GRect::WH(4, 4), paint);
+    canvas->restore();
+    canvas->restore();
+    canvas->drawRect(GRect::XYWH(10, 10, 4, 4), paint);
+    canvas->restore();
+    EXPECT_EQ(stats, (unsigned) GPixel_GetA(pixel_at(bm, 1, 1)), 0x40u);
+    EXPECT_EQ(stats, (unsigned) GPixel_GetA(pixel_at(bm, 11, 11)), 0x80u);
+
+    // a layer with no pixels draws nothing, and its restore leaves the canvas as it was
+    canvas->clear({0, 0, 0, 0});
+    const GRect outside = GRect::XYWH(30, 30, 5, 5);
+    canvas->saveLayer(&outside, GPaint());
+    canvas->clear({1, 1, 1, 1});
+    canvas->drawRect(GRect::WH(20, 20), paint);
+    canvas->restore();
+    EXPECT_EQ(stats, count_nonzero_pixels(bm), 0);
+    canvas->drawRect(GRect::WH(4, 4), paint);
+    EXPECT_EQ(stats, count_nonzero_pixels(bm), 16);
+    free(bm.pixels());
+}
+
+static void test_damage(GTestStats* stats) {
+    const GPaint paint({1, 1, 1, 1});
+
+    GBitmap bm;
+    bm.alloc(100, 100);
+    auto canvas = GCreateCanvas(bm);
+
+    auto same = [](const GIRect& a, const GIRect& b) {
+        return a.left == b.left && a.top == b.top && a.right == b.right && a.bottom == b.bottom;
+    };
+
+    EXPECT_TRUE(stats, canvas->getDamage().isEmpty());
+
+    // damage is the union of the device bounds of each draw
+    canvas->translate(10, 10);
+    canvas->drawRect(GRect::WH(5, 5), paint);
+    EXPECT_TRUE(stats, same(canvas->getDamage(), GIRect::LTRB(10, 10, 15, 15)));
+    canvas->drawRect(GRect::XYWH(20, 30, 10, 10), paint);
+    EXPECT_TRUE(stats, same(canvas->getDamage(), GIRect::LTRB(10, 10, 40, 50)));
+
+    // ... limited by the clip, and by the layer a draw lands in
+    canvas->resetDamage();
+    canvas->save();
+    canvas->clipRect(GRect::WH(20, 20));
+    canvas->drawRect(GRect::LTRB(-100, -100, 100, 100), paint);
+    canvas->restore();
+    EXPECT_TRUE(stats, same(canvas->getDamage(), GIRect::LTRB(10, 10, 30, 30)));
+
+    canvas->resetDamage();
+    const GRect bounds = GRect::XYWH(50, 50, 10, 10);
+    canvas->saveLayer(&bounds, GPaint());
+    canvas->drawRect(GRect::WH(100, 100), paint);
+    EXPECT_TRUE(stats, canvas->getDamage().isEmpty());
+    canvas->restore();
+    EXPECT_TRUE(stats, same(canvas->getDamage(), GIRect::LTRB(60, 60, 70, 70)));
+
+    // nothing visible, nothing damaged
+    canvas->resetDamage();
+    canvas->drawRect(GRect::XYWH(200, 200, 10, 10), paint);
+    EXPECT_TRUE(stats, canvas->getDamage().isEmpty());
+    free(bm.pixels());
+}
+
+static void test_picture_cull(GTestStats* stats) {
+    auto scene = [](GCanvas* canvas) {
+        canvas->drawRect(GRect::XYWH(10, 10, 20, 20), GPaint({1, 0, 0, 1}));   // hidden by the bg
+        canvas->clear({1, 1, 1, 1});
+        canvas->drawRect(GRect::XYWH(10, 10, 20, 20), GPaint({0, 0, 1, 0.5f}));
+        canvas->save();
+        canvas->translate(40, 0);
+        canvas->drawRect(GRect::XYWH(5, 5, 10, 10), GPaint({0, 1, 0, 1}));     // under the panel
+        canvas->drawRect(GRect::WH(40, 20), GPaint({0, 0, 0, 1}));             // opaque panel
+        canvas->restore();
+        canvas->drawRect(GRect::XYWH(30, 30, 20, 20), GPaint({1, 0, 1, 0.5f}));
+        canvas->drawRect(GRect::XYWH(0, 40, 64, 24), GPaint({0, 1, 1, 1}));    // hides half of it
+    };
+
+    GBitmap expected, actual;
+    expected.alloc(64, 64);
+    actual.alloc(64, 64);
+    scene(GCreateCanvas(expected).get());
+
+    GPictureRecorder recorder;
+    scene(recorder.beginRecording(64, 64));
+    auto picture = recorder.finishRecording();
+    EXPECT_EQ(stats, picture->countOps(), 10);
+    EXPECT_EQ(stats, picture->countCulled(), 2);
+
+    picture->playback(GCreateCanvas(actual).get());
+
+    bool same = true;
+    for (int y = 0; y < 64; ++y) {
+        for (int x = 0; x < 64; ++x) {
+            same &= pixel_at(expected, x, y) == pixel_at(actual, x, y);
+        }
+    }
+    EXPECT_TRUE(stats, same);
+    free(expected.pixels());
+    free(actual.pixels());
+}
+
+// an inverse clip keeps what is outside the path, so it must not cull draws outside it
+static void test_picture_inverse_clip(GTestStats* stats) {
+    auto scene = [](GCanvas* canvas) {
+        GPath path;
+        path.addRect(GRect::XYWH(-50, -50, 20, 20));   // off the device
+        path.setFillType(GPath::kInverseWinding_FillType);
+        canvas->clipPath(path);
+        canvas->drawRect(GRect::XYWH(8, 8, 16, 16), GPaint({1, 0, 0, 1}));
+    };
+
+    GBitmap expected, actual;
+    expected.alloc(32, 32);
+    actual.alloc(32, 32);
+    scene(GCreateCanvas(expected).get());
+
+    GPictureRecorder recorder;
+    scene(recorder.beginRecording(32, 32));
+    auto picture = recorder.finishRecording();
+    EXPECT_EQ(stats, picture->countCulled(), 0);
+
+    picture->playback(GCreateCanvas(actual).get());
+
+    int drawn = 0;
+    bool same = true;
+    for (int y = 0; y < 32; ++y) {
+        for (int x = 0; x < 32; ++x) {
+            drawn += pixel_at(expected, x, y) != 0;
+            same &= pixel_at(expected, x, y) == pixel_at(actual, x, y);
+        }
+    }
+    EXPECT_EQ(stats, drawn, 16 * 16);
+    EXPECT_TRUE(stats, same);
+    free(expected.pixels());
+    free(actual.pixels());
+}
+
+static void test_picture_strips(GTestStats* stats) {
+    const int w = 96, h = 70;
+    const GColor colors[] = {{1, 0, 0, 1}, {0, 0, 1, 0.5f}, {0, 1, 0, 1}};
+    auto shader = GCreateLinearGradient({0, 0}, {w, h}, colors, 3);
+
+    auto scene = [&](GCanvas* canvas) {
+        canvas->drawRect(GRect::WH(w, h), GPaint(shader.get()));
+        canvas->drawRect(GRect::XYWH(10, 12, 60, 40), GPaint({1, 1, 0, 0.5f}));
+        const GPoint tri[] = {{48, 2}, {90, 68}, {6, 60}};
+        canvas->drawConvexPolygon(tri, 3, GPaint({0, 0, 0, 0.25f}));
+    };
+
+    // the streamed file decodes to what a full-size render writes
+    GBitmap full;
+    full.alloc(w, h);
+    scene(GCreateCanvas(full).get());
+    full.writeToFile("test_strips_expected.png");
+
+    GPictureRecorder recorder;
+    scene(recorder.beginRecording(w, h));
+    auto picture = recorder.finishRecording();
+    EXPECT_TRUE(stats, GWritePictureStrips(*picture, w, h, 16, "test_strips.png"));
+
+    GBitmap expected, actual;
+    EXPECT_TRUE(stats, expected.readFromFile("test_strips_expected.png"));
+    EXPECT_TRUE(stats, actual.readFromFile("test_strips.png"));
+    EXPECT_EQ(stats, actual.width(), w);
+    EXPECT_EQ(stats, actual.height(), h);
+
+    bool same = actual.width() == w && actual.height() == h;
+    for (int y = 0; same && y < h; ++y) {
+        for (int x = 0; x < w; ++x) {
+            same &= pixel_at(expected, x, y) == pixel_at(actual, x, y);
+        }
+    }
+    EXPECT_TRUE(stats, same);
+
+    remove("test_strips_expected.png");
+    remove("test_strips.png");
+    free(full.pixels());
+    free(expected.pixels());
+    free(actual.pixels());
+}
+
+static void test_png_decode(GTestStats* stats) {
+    // values that survive the unpremultiply in writeToFile exactly
+    const GPixel pixels[] = {
+        GPixel_PackARGB(0xFF, 0x10, 0x80, 0xFF), GPixel_PackARGB(0x80, 0x80, 0x40, 0x00),
+        GPixel_PackARGB(0x00, 0x00, 0x00, 0x00), GPixel_PackARGB(0xFF, 0x00, 0x00, 0x00),
+    };
+
+    GBitmap src, dst;
+    src.alloc(4, 1);
+    memcpy(src.pixels(), pixels, sizeof(pixels));
+    src.writeToFile("test_decode.png");
+
+    EXPECT_TRUE(stats, dst.readFromFile("test_decode.png"));
+    EXPECT_TRUE(stats, !dst.isOpaque());
+    EXPECT_TRUE(stats, memcmp(dst.pixels(), pixels, sizeof(pixels)) == 0);
+    free(dst.pixels());
+
+    // opacity is noted while decoding
+    *src.getAddr(1, 0) = *src.getAddr(2, 0) = GPixel_PackARGB(0xFF, 0xFF, 0xFF, 0xFF);
+    src.writeToFile("test_decode.png");
+    EXPECT_TRUE(stats, dst.readFromFile("test_decode.png"));
+    EXPECT_TRUE(stats, dst.isOpaque());
+    free(dst.pixels());
+
+    EXPECT_TRUE(stats, !dst.readFromFile("test_decode_missing.png"));
+    EXPECT_TRUE(stats, dst.pixels() == nullptr && dst.width() == 0);
+
+    remove("test_decode.png");
+    free(src.pixels());
+}
+
+static void test_png_encode(GTestStats* stats) {
+    // every premultiplied (a, c) pair, as c's of red, green and blue
+    GBitmap src;
+    src.alloc(256, 256);
+    for (int a = 0; a < 256; ++a) {
+        for (int c = 0; c < 256; ++c) {
+            int v = std::min(a, c);
+            *src.getAddr(c, a) = GPixel_PackARGB(a, v, v / 2, a - v);
+        }
+    }
+
+    // what writing (unpremultiply) then reading (premultiply) should give
+    auto roundTrip = [](int a, int c) {
+        int unpremul = a ? (c * 255 + a / 2) / a : 0;
+        return (a * unpremul + 127) / 255;
+    };
+
+    GBitmap dst;
+    bool same = true;
+    for (auto level : { GBitmap::kDefault_PNGLevel, GBitmap::kFast_PNGLevel }) {
+        EXPECT_TRUE(stats, src.writeToFile("test_encode.png", level));
+        EXPECT_TRUE(stats, dst.readFromFile("test_encode.png"));
+
+        for (int a = 0; same && a < 256; ++a) {
+            for (int c = 0; c < 256; ++c) {
+                GPixel s = *src.getAddr(c, a), d = *dst.getAddr(c, a);
+                same &= GPixel_GetA(d) == a &&
+                        GPixel_GetR(d) == roundTrip(a, GPixel_GetR(s)) &&
+                        GPixel_GetG(d) == roundTrip(a, GPixel_GetG(s)) &&
+                        GPixel_GetB(d) == roundTrip(a, GPixel_GetB(s));
+            }
+        }
+        free(dst.pixels());
+    }
+    EXPECT_TRUE(stats, same);
+
+    // the chunks (threads) only change how the stream is split, not what it decodes to
+    GPNGWriter writer;
+    EXPECT_TRUE(stats, writer.begin("test_encode.png", 256, 256, GBitmap::kDefault_PNGLevel, 7));
+    EXPECT_TRUE(stats, writer.writeRows(src, 100));
+    GBitmap rest(256, 156, src.rowBytes(), src.getAddr(0, 100), false);
+    EXPECT_TRUE(stats, writer.writeRows(rest, 156));
+    EXPECT_TRUE(stats, writer.end());
+
+    GBitmap expected;
+    src.writeToFile("test_encode_expected.png");
+    EXPECT_TRUE(stats, expected.readFromFile("test_encode_expected.png"));
+    EXPECT_TRUE(stats, dst.readFromFile("test_encode.png"));
+    EXPECT_TRUE(stats, memcmp(dst.pixels(), expected.pixels(), 256 * 256 * sizeof(GPixel)) == 0);
+
+    remove("test_encode.png");
+    remove("test_encode_expected.png");
+    free(src.pixels());
+    free(dst.pixels());
+    free(expected.pixels());
+}
+
+static void test_raw_map(GTestStats* stats) {
+    GBitmap src;
+    EXPECT_TRUE(stats, src.readFromFile("apps/wheel.png"));
+    EXPECT_TRUE(stats, src.writeToRawFile("test_map.graw"));
+
+    GBitmap mapped;
+    EXPECT_TRUE(stats, mapped.mapFromFile("test_map.graw"));
+    EXPECT_EQ(stats, mapped.width(), src.width());
+    EXPECT_EQ(stats, mapped.height(), src.height());
+    EXPECT_TRUE(stats, mapped.isOpaque() == src.isOpaque());
+    EXPECT_TRUE(stats, mapped.rowBytes() % 64 == 0);
+    EXPECT_TRUE(stats, (uintptr_t)mapped.pixels() % 64 == 0);
+
+    bool same = true;
+    for (int y = 0; y < src.height(); ++y) {
+        same &= !memcmp(mapped.getAddr(0, y), src.getAddr(0, y), src.width() * sizeof(GPixel));
+    }
+    EXPECT_TRUE(stats, same);
+
+    // drawing into the mapping leaves the file alone
+    GCreateCanvas(mapped)->clear({1, 0, 0, 1});
+    mapped.unmapFile();
+    EXPECT_TRUE(stats, mapped.pixels() == nullptr);
+    EXPECT_TRUE(stats, mapped.mapFromFile("test_map.graw"));
+    EXPECT_TRUE(stats, *mapped.getAddr(0, 0) == *src.getAddr(0, 0));
+    mapped.unmapFile();
+
+    // a PNG is not a raw file
+    EXPECT_TRUE(stats, !mapped.mapFromFile("apps/wheel.png"));
+    EXPECT_TRUE(stats, mapped.pixels() == nullptr);
+
+    // nor is one whose rows aren't whole pixels, even if the file is long enough for them
+    // (12 and 20 are the offsets of RawHeader's fWidth and fRowBytes)
+    auto patch = [](long offset, uint32_t value) {
+        FILE* f = fopen("test_map.graw", "r+b");
+        fseek(f, offset, SEEK_SET);
+        fwrite(&value, sizeof(value), 1, f);
+        fclose(f);
+    };
+    patch(12, src.width() - 1);
+    patch(20, 4 * src.width() - 2);
+    EXPECT_TRUE(stats, !mapped.mapFromFile("test_map.graw"));
+    EXPECT_TRUE(stats, mapped.pixels() == nullptr);
+
+    remove("test_map.graw");
+    free(src.pixels());
+}
+
+static void test_float_canvas(GTestStats* stats) {
+    GBitmapF fbm;
+    fbm.alloc(8, 8);
+    auto canvas = GCreateCanvasF(fbm);
+
+    // many faint layers: float keeps the exact result where 8 bits would round every step
+    canvas->clear({0, 0, 0, 1});
+    const float alpha = 1 / 64.0f;
+    for (int i = 0; i < 100; ++i) {
+        canvas->drawRect(GRect::WH(8, 8), GPaint({1, 1, 1, alpha}));
+    }
+    const float expected = 1 - powf(1 - alpha, 100);
+    const GPixelF p = *fbm.getAddr(3, 3);
+    EXPECT_TRUE(stats, fabsf(p.r - expected) < 1e-4f);
+    EXPECT_TRUE(stats, fabsf(p.a - 1) < 1e-6f);
+
+    // otherwise it draws what the 8-bit canvas draws, give or take rounding
+    GBitmap a, b;
+    a.alloc(8, 8);
+    b.alloc(8, 8);
+    const GColor colors[] = {{1, 0, 0, 1}, {0, 0, 1, 0.5f}};
+    auto shader = GCreateLinearGradient({0, 0}, {8, 8}, colors, 2);
+    GPaint paint(shader.get());
+
+    canvas->clear({0, 0, 0, 0});
+    canvas->drawRect(GRect::WH(8, 8), paint);
+    canvas->drawRect(GRect::XYWH(2, 2, 4, 4), GPaint({0, 1, 0, 0.5f}));
+    fbm.readPixels(a);
+
+    auto canvas8 = GCreateCanvas(b);
+    canvas8->drawRect(GRect::WH(8, 8), paint);
+    canvas8->drawRect(GRect::XYWH(2, 2, 4, 4), GPaint({0, 1, 0, 0.5f}));
+
+    int maxDiff = 0;
+    for (int y = 0; y < 8; ++y) {
+        for (int x = 0; x < 8; ++x) {
+            GPixel p0 = pixel_at(a, x, y), p1 = pixel_at(b, x, y);
+            maxDiff = std::max(maxDiff, abs(GPixel_GetA(p0) - GPixel_GetA(p1)));
+            maxDiff = std::max(maxDiff, abs(GPixel_GetR(p0) - GPixel_GetR(p1)));
+            maxDiff = std::max(maxDiff, abs(GPixel_GetG(p0) - GPixel_GetG(p1)));
+            maxDiff = std::max(maxDiff, abs(GPixel_GetB(p0) - GPixel_GetB(p1)));
+        }
+    }
+    EXPECT_TRUE(stats, maxDiff <= 1);
+    free(fbm.pixels());
+    free(a.pixels());
+    free(b.pixels());
+}
+
+// the same scene (shader, translucent draws, an alpha layer) on any canvas
+static void draw_compact_scene(GCanvas* canvas, GShader* shader) {
+    canvas->drawRect(GRect::XYWH(1, 1, 10, 6), GPaint(shader));
+    canvas->drawRect(GRect::XYWH(4, 3, 8, 8), GPaint({1, 0, 0, 0.5f}));
+
+    GPaint layerPaint;
+    layerPaint.setAlpha(0.5f);
+    canvas->saveLayer(nullptr, layerPaint);
+    const GPoint tri[] = {{0, 12}, {12, 12}, {6, 2}};
+    canvas->drawConvexPolygon(tri, 3, GPaint({0, 1, 0, 0.75f}));
+    canvas->restore();
+}
+
+static void test_compact_canvas(GTestStats* stats) {
+    const GColor colors[] = {{1, 1, 0, 1}, {0, 0, 1, 0.25f}};
+    auto shader = GCreateLinearGradient({0, 0}, {12, 0}, colors, 2);
+
+    // A8 computes exactly the alpha of the 32-bit canvas
+    GBitmap ref;
+    ref.alloc(12, 12);
+    draw_compact_scene(GCreateCanvas(ref).get(), shader.get());
+
+    GBitmapA8 a8;
+    a8.alloc(12, 12);
+    draw_compact_scene(GCreateCanvasA8(a8).get(), shader.get());
+
+    bool sameAlpha = true;
+    for (int y = 0; y < 12; ++y) {
+        for (int x = 0; x < 12; ++x) {
+            sameAlpha &= *a8.getAddr(x, y) == GPixel_GetA(pixel_at(ref, x, y));
+        }
+    }
+    EXPECT_TRUE(stats, sameAlpha);
+
+    // 565 matches the 32-bit canvas to within its 5/6 bits (plus rounding along the way)
+    const GColor bg = {0.25f, 0.5f, 0.75f, 1};
+    auto canvas = GCreateCanvas(ref);
+    canvas->clear(bg);
+    draw_compact_scene(canvas.get(), shader.get());
+
+    GBitmap565 bm565;
+    bm565.alloc(12, 12);
+    auto canvas565 = GCreateCanvas565(bm565);
+    canvas565->clear(bg);
+    draw_compact_scene(canvas565.get(), shader.get());
+
+    GBitmap wide;
+    wide.alloc(12, 12);
+    bm565.readPixels(wide);
+
+    int maxDiff = 0;
+    for (int y = 0; y < 12; ++y) {
+        for (int x = 0; x < 12; ++x) {
+            GPixel p0 = pixel_at(wide, x, y), p1 = pixel_at(ref, x, y);
+            maxDiff = std::max(maxDiff, abs(GPixel_GetR(p0) - GPixel_GetR(p1)));
+            maxDiff = std::max(maxDiff, abs(GPixel_GetG(p0) - GPixel_GetG(p1)));
+            maxDiff = std::max(maxDiff, abs(GPixel_GetB(p0) - GPixel_GetB(p1)));
+        }
+    }
+    EXPECT_TRUE(stats, maxDiff <= 12);
+    EXPECT_EQ(stats, GPixel_GetA(pixel_at(wide, 5, 5)), 0xFF);
+
+    free(ref.pixels());
+    free(a8.pixels());
+    free(bm565.pixels());
+    free(wide.pixels());
+}
+
+// Draws seeded fuzz scenes straight into one canvas and with render(canvas, seed) into another,
+// and expects the same pixels from both.
+template <typename Render> static void expect_fuzz_matches(GTestStats* stats, Render render) {
+    GBitmap direct, other;
+    direct.alloc(64, 64);
+    other.alloc(64, 64);
+    for (uint32_t seed = 1; seed <= 8; ++seed) {
+        auto canvas = GCreateCanvas(direct);
+        canvas->clear({0, 0, 0, 0});
+        FuzzScene({64, 64}, seed).draw(canvas.get(), 20);
+
+        canvas = GCreateCanvas(other);
+        canvas->clear({0, 0, 0, 0});
+        render(canvas.get(), seed);
+        EXPECT_TRUE(stats, !memcmp(direct.pixels(), other.pixels(), 64 * 64 * sizeof(GPixel)));
+    }
+    free(direct.pixels());
+    free(other.pixels());
+}
+
+static void test_reference_mode(GTestStats* stats) {
+    // a level-0 quad is two triangles
+    GBitmap bm;
+    bm.alloc(8, 8);
+    auto canvas = GCreateCanvas(bm);
+    const GPoint verts[] = {{0, 0}, {8, 0}, {8, 8}, {0, 8}};
+    const GColor colors[] = {{1, 0, 0, 1}, {1, 0, 0, 1}, {1, 0, 0, 1}, {1, 0, 0, 1}};
+    canvas->drawQuad(verts, colors, nullptr, 0, GPaint());
+    EXPECT_EQ(stats, pixel_at(bm, 1, 6), GPixel_PackARGB(0xFF, 0xFF, 0, 0));
+    EXPECT_EQ(stats, pixel_at(bm, 6, 1), GPixel_PackARGB(0xFF, 0xFF, 0, 0));
+
+    // the fast paths and the reference draw the same pixels
+    expect_fuzz_matches(stats, [](GCanvas* canvas, uint32_t seed) {
+        GSetReferenceMode(true);
+        FuzzScene({64, 64}, seed).draw(canvas, 20);
+        GSetReferenceMode(false);
+    });
+    EXPECT_TRUE(stats, !GGetReferenceMode());
+
+    free(bm.pixels());
+}
+
+static long file_size(const char path[]) {
+    struct stat st;
+    return stat(path, &st) == 0 ? (long)st.st_size : -1;
+}
+
+static void test_trace(GTestStats* stats) {
+    // a traced scene replays to the pixels it draws directly
+    expect_fuzz_matches(stats, [stats](GCanvas* canvas, uint32_t seed) {
+        FuzzScene({64, 64}, seed).draw(GCreateTraceCanvas("test_trace.gtrace", {64, 64}).get(),
+                                       20);
+        auto trace = GLoadTrace("test_trace.gtrace");
+        EXPECT_TRUE(stats, trace != nullptr);
+        if (trace) {
+            EXPECT_EQ(stats, trace->size().width, 64);
+            EXPECT_TRUE(stats, trace->countCalls() > 0);
+            trace->playback(canvas);
+        }
+    });
+
+    // the calls are forwarded to the target as they are traced
+    GBitmap live;
+    live.alloc(16, 16);
+    auto liveCanvas = GCreateCanvas(live);
+    GCreateTraceCanvas("test_trace.gtrace", {16, 16}, liveCanvas.get())
+        ->drawRect(GRect::WH(4, 4), GPaint({1, 0, 0, 1}));
+    EXPECT_EQ(stats, pixel_at(live, 1, 1), GPixel_PackARGB(0xFF, 0xFF, 0, 0));
+
+    // a bitmap drawn by several shaders is written once
+    GBitmap texture;
+    texture.alloc(32, 32);
+    GCreateCanvas(texture)->clear({0, 0, 1, 1});
+    auto trace_texture = [&](int draws) {
+        auto tracer = GCreateTraceCanvas("test_trace.gtrace", {16, 16});
+        for (int i = 0; i < draws; ++i) {
+            auto shader = GCreateBitmapShader(texture, GMatrix::Translate(i, 0));
+            tracer->drawRect(GRect::WH(16, 16), GPaint(shader.get()));
+        }
+        tracer.reset();
+        return file_size("test_trace.gtrace");
+    };
+    const long once = trace_texture(1);
+    EXPECT_TRUE(stats, once > 32 * 32 * (long)sizeof(GPixel));
+    EXPECT_TRUE(stats, trace_texture(3) - once < 32 * 32 * (long)sizeof(GPixel));
+
+    // what a shader describes makes the same shader again
+    const GColor gradColors[] = {{1, 0, 0, 1}, {0, 1, 0, 0.5f}, {0, 0, 1, 1}};
+    std::unique_ptr<GShader> shaders[] = {
+        GCreateBitmapShader(texture, GMatrix::Rotate(0.5f) * GMatrix::Scale(0.3f, 0.7f),
+                            GTileMode::kMirror),
+        GCreateLinearGradient({2, 3}, {13, 9}, gradColors, 3, GTileMode::kRepeat),
+    };
+    GBitmap remade;
+    remade.alloc(16, 16);
+    for (auto& shader : shaders) {
+        GShaderDesc desc;
+        EXPECT_TRUE(stats, shader->describe(&desc));
+        auto again = desc.type == GShaderDesc::kBitmap
+                   ? GCreateBitmapShader(*desc.bitmap, desc.localMatrix, desc.tileMode)
+                   : GCreateLinearGradient(desc.p0, desc.p1, desc.colors.data(),
+                                           (int)desc.colors.size(), desc.tileMode);
+        GCreateCanvas(live)->drawRect(GRect::WH(16, 16), GPaint(shader.get()));
+        GCreateCanvas(remade)->drawRect(GRect::WH(16, 16), GPaint(again.get()));
+        EXPECT_TRUE(stats, !memcmp(live.pixels(), remade.pixels(), 16 * 16 * sizeof(GPixel)));
+    }
+
+    // a trace cut short, or that isn't one, is rejected
+    GCreateTraceCanvas("test_trace.gtrace", {64, 64})->drawRect(GRect::WH(10, 10), GPaint());
+    EXPECT_TRUE(stats, GLoadTrace("test_trace.gtrace") != nullptr);
+    EXPECT_TRUE(stats, truncate("test_trace.gtrace", file_size("test_trace.gtrace") - 1) == 0);
+    EXPECT_TRUE(stats, GLoadTrace("test_trace.gtrace") == nullptr);
+    EXPECT_TRUE(stats, GLoadTrace("apps/wheel.png") == nullptr);
+    remove("test_trace.gtrace");
+
+    free(live.pixels());
+    free(texture.pixels());
+    free(remade.pixels());
+}
@@ -14,6 +14,7 @@
 #include "tests_pa3.cpp"
 #include "tests_pa4.cpp"
 #include "tests_pa5.cpp"
+#include "tests_pa6.cpp"
 
 const GTestRec gTestRecs[] = {
     { test_clear,       "clear"         },
@@ -39,6 +40,25 @@ const GTestRec gTestRecs[] = {
     { test_path_chop_cubic,   "path_chop_cubic"    },
     { test_path_bounds, "path_bounds" },
 
+    { test_path_filltype, "path_filltype" },
+    { test_path_giant_curve, "path_giant_curve" },
+    { test_big_device,    "big_device"    },
+    { test_path_stroke,   "path_stroke"   },
+    { test_hairline,      "hairline"      },
+    { test_clip,          "clip"          },
+    { test_save_layer,    "save_layer"    },
+    { test_damage,        "damage"        },
+    { test_picture_cull,  "picture_cull"  },
+    { test_picture_inverse_clip, "picture_inverse_clip" },
+    { test_picture_strips, "picture_strips" },
+    { test_png_decode,    "png_decode"    },
+    { test_png_encode,    "png_encode"    },
+    { test_raw_map,       "raw_map"       },
+    { test_reference_mode, "reference_mode" },
+    { test_trace,         "trace"         },
+    { test_float_canvas,  "float_canvas"  },
+    { test_compact_canvas, "compact_canvas" },
+
     { nullptr, nullptr },
 };
 
@@ -0,0 +1,45 @@
+#ifndef _g_blend_modes_a8_h_
+#define _g_blend_modes_a8_h_
+
+#include "include/GPixelCompact.h"
+
+// Alpha-only versions of the modes in blendModes.h: each is the alpha channel of its GPixel mode,
+// computed with the same helpers (so include this after blendModes.h).
+
+// kClear,    //!<     0
+GPixelA8 clearModeA8(const GPixelA8 src, const GPixelA8 dst) { return 0; }
+
+// kSrc,      //!<     S
+GPixelA8 srcModeA8(const GPixelA8 src, const GPixelA8 dst) { return src; }
+
+// kDst,      //!<     D
+GPixelA8 dstModeA8(const GPixelA8 src, const GPixelA8 dst) { return dst; }
+
+// kSrcOver,  //!<     S + (1 - Sa)*D
+GPixelA8 srcOverModeA8(const GPixelA8 src, const GPixelA8 dst) { return computeOver(src, dst, src); }
+
+// kDstOver,  //!<     D + (1 - Da) * S
+GPixelA8 dstOverModeA8(const GPixelA8 src, const GPixelA8 dst) { return computeOver(dst, src, dst); }
+
+// kSrcIn,    //!<     Da * S
+GPixelA8 srcInModeA8(const GPixelA8 src, const GPixelA8 dst) { return computeIn(src, dst); }
+
+// kDstIn,    //!<     Sa * D
+GPixelA8 dstInModeA8(const GPixelA8 src, const GPixelA8 dst) { return computeIn(dst, src); }
+
+// kSrcOut,   //!<     (1 - Da)*S
+GPixelA8 srcOutModeA8(const GPixelA8 src, const GPixelA8 dst) { return computeOut(src, dst); }
+
+// kDstOut,   //!<     (1 - Sa)*D
+GPixelA8 dstOutModeA8(const GPixelA8 src, const GPixelA8 dst) { return computeOut(dst, src); }
+
+// kSrcATop,  //!<     Da*S + (1 - Sa)*D  (= Da)
+GPixelA8 srcATopModeA8(const GPixelA8 src, const GPixelA8 dst) { return computeATop(src, dst, src, dst); }
+
+// kDstATop,  //!<     Sa*D + (1 - Da)*S  (= Sa)
+GPixelA8 dstATopModeA8(const GPixelA8 src, const GPixelA8 dst) { return computeATop(dst, src, dst, src); }
+
+// kXor,      //!<     (1 - Sa)*D + (1 - Da)*S
+GPixelA8 xorModeA8(const GPixelA8 src, const GPixelA8 dst) { return computeXor(src, dst, src, dst); }
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef _g_blend_modes_f_h_
+#define _g_blend_modes_f_h_
+
+#include "include/GPixelF.h"
+
+// Float versions of the modes in blendModes.h. Every Porter-Duff mode is S*Fs + D*Fd for some
+// factors, and without the 8-bit rounding there is no need for per-mode integer tricks.
+static inline GPixelF blendF(const GPixelF& s, float fs, const GPixelF& d, float fd) {
+  return { s.r * fs + d.r * fd, s.g * fs + d.g * fd, s.b * fs + d.b * fd, s.a * fs + d.a * fd };
+}
+
+// kClear,    //!<     0
+GPixelF clearModeF(const GPixelF src, const GPixelF dst) { return { 0, 0, 0, 0 }; }
+
+// kSrc,      //!<     S
+GPixelF srcModeF(const GPixelF src, const GPixelF dst) { return src; }
+
+// kDst,      //!<     D
+GPixelF dstModeF(const GPixelF src, const GPixelF dst) { return dst; }
+
+// kSrcOver,  //!<     S + (1 - Sa)*D
+GPixelF srcOverModeF(const GPixelF src, const GPixelF dst) { return blendF(src, 1, dst, 1 - src.a); }
+
+// kDstOver,  //!<     D + (1 - Da) * S
+GPixelF dstOverModeF(const GPixelF src, const GPixelF dst) { return blendF(src, 1 - dst.a, dst, 1); }
+
+// kSrcIn,    //!<     Da * S
+GPixelF srcInModeF(const GPixelF src, const GPixelF dst) { return blendF(src, dst.a, dst, 0); }
+
+// kDstIn,    //!<     Sa * D
+GPixelF dstInModeF(const GPixelF src, const GPixelF dst) { return blendF(src, 0, dst, src.a); }
+
+// kSrcOut,   //!<     (1 - Da)*S
+GPixelF srcOutModeF(const GPixelF src, const GPixelF dst) { return blendF(src, 1 - dst.a, dst, 0); }
+
+// kDstOut,   //!<     (1 - Sa)*D
+GPixelF dstOutModeF(const GPixelF src, const GPixelF dst) { return blendF(src, 0, dst, 1 - src.a); }
+
+// kSrcATop,  //!<     Da*S + (1 - Sa)*D
+GPixelF srcATopModeF(const GPixelF src, const GPixelF dst) { return blendF(src, dst.a, dst, 1 - src.a); }
+
+// kDstATop,  //!<     Sa*D + (1 - Da)*S
+GPixelF dstATopModeF(const GPixelF src, const GPixelF dst) { return blendF(src, 1 - dst.a, dst, src.a); }
+
+// kXor,      //!<     (1 - Sa)*D + (1 - Da)*S
+GPixelF xorModeF(const GPixelF src, const GPixelF dst) { return blendF(src, 1 - dst.a, dst, 1 - src.a); }
+
+#endif
@@ -1,42 +1,117 @@
 #include "include/GColor.h"
 #include "include/GRect.h"
+#include "include/GPath.h"
+#include "include/GPixelF.h"
+#include "include/GPixelCompact.h"
+#include "include/GProfile.h"
+#include "include/GReference.h"
 #include "blendModes.h"
+#include "blendModesF.h"
+#include "blendModesA8.h"
 #include "shader.h"
+#include "clipMask.h"
 #include <iostream>
 
 typedef GPixel(*BlendProc) (GPixel, GPixel);
+typedef GPixelF(*BlendProcF) (GPixelF, GPixelF);
+typedef GPixelA8(*BlendProcA8) (GPixelA8, GPixelA8);
 
 const BlendProc gProcs[] = {
   clearMode, srcMode, dstMode, srcOverMode, dstOverMode, srcInMode, dstInMode, 
   srcOutMode, dstOutMode, srcATopMode, dstATopMode, xorMode
 };
 
-BlendProc simplify_blend_mode(const GPaint& paint, BlendProc blendMode) {
-  if (paint.getAlpha() == 1.0f) {
-      if (blendMode == srcOverMode) return srcMode;
-      if (blendMode == dstInMode) return dstMode;
-      if (blendMode == srcATopMode) return srcInMode;
-      if (blendMode == dstOutMode) return clearMode;
-      if (blendMode == xorMode) return srcOutMode;
-    } else if (paint.getAlpha() == 0.0f) {
-      if (blendMode == srcMode) return clearMode;
-      if (blendMode == srcOverMode) return dstMode;
-      if (blendMode == dstOverMode) return dstMode;
-      if (blendMode == srcInMode) return clearMode;
-      if (blendMode == dstInMode) return clearMode;
-      if (blendMode == srcOutMode) return clearMode;
-      if (blendMode == dstOutMode) return dstMode;
-      if (blendMode == srcATopMode) return dstMode;
-      if (blendMode == dstATopMode) return clearMode;
-      if (blendMode == xorMode) return dstMode;
+const BlendProcF gProcsF[] = {
+  clearModeF, srcModeF, dstModeF, srcOverModeF, dstOverModeF, srcInModeF, dstInModeF,
+  srcOutModeF, dstOutModeF, srcATopModeF, dstATopModeF, xorModeF
+};
+
+const BlendProcA8 gProcsA8[] = {
+  clearModeA8, srcModeA8, dstModeA8, srcOverModeA8, dstOverModeA8, srcInModeA8, dstInModeA8,
+  srcOutModeA8, dstOutModeA8, srcATopModeA8, dstATopModeA8, xorModeA8
+};
+
+// What a device's sources are and how they blend, so the scan conversion below is shared by
+// every canvas. Pixel is what colors and shaders produce, which is not always what the device
+// stores: a 565 device has no alpha, so its sources stay 32-bit and are packed as they land.
+template <typename Device> struct DeviceTraits;
+
+template <> struct DeviceTraits<GBitmap> {
+  typedef GPixel Pixel;
+  typedef BlendProc Proc;
+
+  static Proc proc(GBlendMode mode) { return gProcs[(int) mode]; }
+};
+
+template <> struct DeviceTraits<GBitmapF> {
+  typedef GPixelF Pixel;
+  typedef BlendProcF Proc;
+
+  static Proc proc(GBlendMode mode) { return gProcsF[(int) mode]; }
+};
+
+template <> struct DeviceTraits<GBitmapA8> {
+  typedef GPixelA8 Pixel;
+  typedef BlendProcA8 Proc;
+
+  static Proc proc(GBlendMode mode) { return gProcsA8[(int) mode]; }
+};
+
+template <> struct DeviceTraits<GBitmap565> {
+  typedef GPixel Pixel;
+  typedef BlendProc Proc;
+
+  static Proc proc(GBlendMode mode) { return gProcs[(int) mode]; }
+};
+
+// A src alpha of exactly 1 or 0 lets several modes collapse into cheaper ones
+GBlendMode simplify_blend_mode(float alpha, GBlendMode mode) {
+  if (GGetReferenceMode()) return mode;
+
+  if (alpha == 1.0f) {
+    switch (mode) {
+      case GBlendMode::kSrcOver:  return GBlendMode::kSrc;
+      case GBlendMode::kDstIn:    return GBlendMode::kDst;
+      case GBlendMode::kSrcATop:  return GBlendMode::kSrcIn;
+      case GBlendMode::kDstOut:   return GBlendMode::kClear;
+      case GBlendMode::kXor:      return GBlendMode::kSrcOut;
+      default:                    return mode;
+    }
+  } else if (alpha == 0.0f) {
+    switch (mode) {
+      case GBlendMode::kSrc:      return GBlendMode::kClear;
+      case GBlendMode::kSrcOver:  return GBlendMode::kDst;
+      case GBlendMode::kDstOver:  return GBlendMode::kDst;
+      case GBlendMode::kSrcIn:    return GBlendMode::kClear;
+      case GBlendMode::kDstIn:    return GBlendMode::kClear;
+      case GBlendMode::kSrcOut:   return GBlendMode::kClear;
+      case GBlendMode::kDstOut:   return GBlendMode::kDst;
+      case GBlendMode::kSrcATop:  return GBlendMode::kDst;
+      case GBlendMode::kDstATop:  return GBlendMode::kClear;
+      case GBlendMode::kXor:      return GBlendMode::kDst;
+      default:                    return mode;
+    }
   }
-  return blendMode;
+  return mode;
+}
+
+GBlendMode simplify_blend_mode(const GPaint& paint, GBlendMode mode) {
+  return simplify_blend_mode(paint.getAlpha(), mode);
+}
+
+// An opaque shader lets the same modes collapse as an opaque color
+GBlendMode simplify_shader_blend_mode(GShader* sh, GBlendMode mode) {
+  return sh->isOpaque() ? simplify_blend_mode(1.0f, mode) : mode;
 }
 
 template<typename Proc> void blend_shader_row(const GBitmap& bm, const GPixel row[], int x, int y, int width, Proc blend) {
   auto pixel = bm.getAddr(x, y);  
 
-  if (blend == srcMode) {
+  if (GGetReferenceMode()) {
+    for (int i = 0; i < width; i++) {
+      pixel[i] = blend(row[i], pixel[i]);
+    }
+  } else if (blend == srcMode) {
     for (int i = 0; i < width; i++) {
       pixel[i] = srcMode(row[i], pixel[i]);
     }
@@ -94,7 +169,11 @@ template<typename Proc> void blend_shader_row(const GBitmap& bm, const GPixel ro
 template<typename Proc> void blend_row(const GBitmap& bm, const GPixel& src, int x, int y, int width, Proc blend) {
   auto pixel = bm.getAddr(x, y);  
 
-  if (blend == srcMode) {
+  if (GGetReferenceMode()) {
+    for (int i = 0; i < width; i++) {
+      pixel[i] = blend(src, pixel[i]);
+    }
+  } else if (blend == srcMode) {
     for (int i = 0; i < width; i++) {
       pixel[i] = srcMode(src, pixel[i]);
     }
@@ -176,8 +255,340 @@ GPixel color_to_pixel(const GColor& color) {
   return GPixel_PackARGB(prem.a, prem.r, prem.g, prem.b);
 }
 
+// no rounding, and no clamping either: the float device keeps values above 1
+GPixelF color_to_pixelF(const GColor& color) {
+  return { color.r * color.a, color.g * color.a, color.b * color.a, color.a };
+}
+
+template <typename Pixel> Pixel color_to(const GColor& color);
+template <> GPixel color_to<GPixel>(const GColor& color) { return color_to_pixel(color); }
+template <> GPixelF color_to<GPixelF>(const GColor& color) { return color_to_pixelF(color); }
+template <> GPixelA8 color_to<GPixelA8>(const GColor& color) { return GRoundToInt(color.a * 255); }
+
+void shade_row(GShader* sh, int x, int y, int count, GPixel row[]) { sh->shadeRow(x, y, count, row); }
+void shade_row(GShader* sh, int x, int y, int count, GPixelF row[]) { sh->shadeRowF(x, y, count, row); }
+void shade_row(GShader* sh, int x, int y, int count, GPixelA8 row[]) { sh->shadeRowA8(x, y, count, row); }
+
+// The float rows only special-case the common modes. Their loops are plain multiply-adds over
+// four floats, which the compiler vectorizes; everything else goes through the proc.
+void blend_row(const GBitmapF& bm, const GPixelF& src, int x, int y, int width, BlendProcF blend) {
+  GPixelF* pixel = bm.getAddr(x, y);
+
+  if (GGetReferenceMode()) {
+    for (int i = 0; i < width; i++) {
+      pixel[i] = blend(src, pixel[i]);
+    }
+  } else if (blend == srcModeF) {
+    std::fill(pixel, pixel + width, src);
+  } else if (blend == srcOverModeF) {
+    const float k = 1 - src.a;
+    for (int i = 0; i < width; i++) {
+      pixel[i] = { src.r + pixel[i].r * k, src.g + pixel[i].g * k,
+                   src.b + pixel[i].b * k, src.a + pixel[i].a * k };
+    }
+  } else if (blend != dstModeF) {
+    for (int i = 0; i < width; i++) {
+      pixel[i] = blend(src, pixel[i]);
+    }
+  }
+}
+
+void blend_shader_row(const GBitmapF& bm, const GPixelF row[], int x, int y, int width, BlendProcF blend) {
+  GPixelF* pixel = bm.getAddr(x, y);
+
+  if (GGetReferenceMode()) {
+    for (int i = 0; i < width; i++) {
+      pixel[i] = blend(row[i], pixel[i]);
+    }
+  } else if (blend == srcModeF) {
+    std::copy(row, row + width, pixel);
+  } else if (blend == srcOverModeF) {
+    for (int i = 0; i < width; i++) {
+      const float k = 1 - row[i].a;
+      pixel[i] = { row[i].r + pixel[i].r * k, row[i].g + pixel[i].g * k,
+                   row[i].b + pixel[i].b * k, row[i].a + pixel[i].a * k };
+    }
+  } else if (blend != dstModeF) {
+    for (int i = 0; i < width; i++) {
+      pixel[i] = blend(row[i], pixel[i]);
+    }
+  }
+}
+
+// A8 rows work on coverage alone, a quarter of the bytes of a GPixel row
+void blend_row(const GBitmapA8& bm, const GPixelA8& src, int x, int y, int width, BlendProcA8 blend) {
+  GPixelA8* pixel = bm.getAddr(x, y);
+
+  if (GGetReferenceMode()) {
+    for (int i = 0; i < width; i++) {
+      pixel[i] = blend(src, pixel[i]);
+    }
+  } else if (blend == srcModeA8) {
+    memset(pixel, src, width);
+  } else if (blend == srcOverModeA8) {
+    for (int i = 0; i < width; i++) {
+      pixel[i] = src + GDiv255((255 - src) * pixel[i]);
+    }
+  } else if (blend != dstModeA8) {
+    for (int i = 0; i < width; i++) {
+      pixel[i] = blend(src, pixel[i]);
+    }
+  }
+}
+
+void blend_shader_row(const GBitmapA8& bm, const GPixelA8 row[], int x, int y, int width, BlendProcA8 blend) {
+  GPixelA8* pixel = bm.getAddr(x, y);
+
+  if (GGetReferenceMode()) {
+    for (int i = 0; i < width; i++) {
+      pixel[i] = blend(row[i], pixel[i]);
+    }
+  } else if (blend == srcModeA8) {
+    memcpy(pixel, row, width);
+  } else if (blend == srcOverModeA8) {
+    for (int i = 0; i < width; i++) {
+      pixel[i] = row[i] + GDiv255((255 - row[i]) * pixel[i]);
+    }
+  } else if (blend != dstModeA8) {
+    for (int i = 0; i < width; i++) {
+      pixel[i] = blend(row[i], pixel[i]);
+    }
+  }
+}
+
+// 565 rows blend the 32-bit source with the widened (opaque) dst, and store the packed result.
+// kSrc packs once for the whole span.
+void blend_row(const GBitmap565& bm, const GPixel& src, int x, int y, int width, BlendProc blend) {
+  GPixel565* pixel = bm.getAddr(x, y);
+
+  if (GGetReferenceMode()) {
+    for (int i = 0; i < width; i++) {
+      pixel[i] = GPixel565_FromPixel(blend(src, GPixel565_ToPixel(pixel[i])));
+    }
+  } else if (blend == srcMode) {
+    std::fill(pixel, pixel + width, GPixel565_FromPixel(src));
+  } else if (blend == srcOverMode) {
+    // the dst is opaque, so only the colors need blending
+    unsigned r = GPixel_GetR(src), g = GPixel_GetG(src), b = GPixel_GetB(src);
+    unsigned k = 255 - GPixel_GetA(src);
+    for (int i = 0; i < width; i++) {
+      GPixel d = GPixel565_ToPixel(pixel[i]);
+      pixel[i] = GPixel565_FromRGB(r + GDiv255(GPixel_GetR(d) * k), g + GDiv255(GPixel_GetG(d) * k),
+                                   b + GDiv255(GPixel_GetB(d) * k));
+    }
+  } else if (blend != dstMode) {
+    for (int i = 0; i < width; i++) {
+      pixel[i] = GPixel565_FromPixel(blend(src, GPixel565_ToPixel(pixel[i])));
+    }
+  }
+}
+
+void blend_shader_row(const GBitmap565& bm, const GPixel row[], int x, int y, int width, BlendProc blend) {
+  GPixel565* pixel = bm.getAddr(x, y);
+
+  if (GGetReferenceMode()) {
+    for (int i = 0; i < width; i++) {
+      pixel[i] = GPixel565_FromPixel(blend(row[i], GPixel565_ToPixel(pixel[i])));
+    }
+  } else if (blend == srcMode) {
+    for (int i = 0; i < width; i++) {
+      pixel[i] = GPixel565_FromPixel(row[i]);
+    }
+  } else if (blend == srcOverMode) {
+    for (int i = 0; i < width; i++) {
+      pixel[i] = GPixel565_FromPixel(srcOverMode(row[i], GPixel565_ToPixel(pixel[i])));
+    }
+  } else if (blend != dstMode) {
+    for (int i = 0; i < width; i++) {
+      pixel[i] = GPixel565_FromPixel(blend(row[i], GPixel565_ToPixel(pixel[i])));
+    }
+  }
+}
+
+// Scale a row of pixels by alpha in [0, 1]
+void scale_row(const GPixel src[], GPixel dst[], int count, float alpha) {
+  int a = GRoundToInt(alpha * 255);
+  for (int x = 0; x < count; x++) {
+    GPixel p = src[x];
+    dst[x] = GPixel_PackARGB(GDiv255(GPixel_GetA(p) * a), GDiv255(GPixel_GetR(p) * a),
+                             GDiv255(GPixel_GetG(p) * a), GDiv255(GPixel_GetB(p) * a));
+  }
+}
+
+void scale_row(const GPixelF src[], GPixelF dst[], int count, float alpha) {
+  for (int x = 0; x < count; x++) {
+    dst[x] = { src[x].r * alpha, src[x].g * alpha, src[x].b * alpha, src[x].a * alpha };
+  }
+}
+
+void scale_row(const GPixelA8 src[], GPixelA8 dst[], int count, float alpha) {
+  int a = GRoundToInt(alpha * 255);
+  for (int x = 0; x < count; x++) {
+    dst[x] = GDiv255(src[x] * a);
+  }
+}
+
+// Blend src into [x, x + width) on row y, skipping whatever the clip excludes
+template <typename Device, typename Pixel, typename Proc>
+void blit_row(const Device& bm, const DeviceClip& clip, const Pixel& src, int x, int y, int width, Proc blend) {
+  clip.clipRow(y, x, x + width, [&](int l, int r) {
+    G_PROFILE_SPAN(r - l);
+    G_PROFILE_STAGE(kBlend_Stage);
+    blend_row(bm, src, l, y, r - l, blend);
+  });
+}
+
+// Shade the part of [x, x + width) inside the clip bounds once, then blend the runs the clip keeps
+template <typename Device, typename Proc>
+void blit_shader_row(const Device& bm, const DeviceClip& clip, GShader* sh, int x, int y, int width, Proc blend) {
+  int l0 = std::max(x, clip.bounds.left);
+  int r0 = std::min(x + width, clip.bounds.right);
+
+  if (l0 >= r0 || y < clip.bounds.top || y >= clip.bounds.bottom) return;
+
+  typename DeviceTraits<Device>::Pixel row[r0 - l0];
+  {
+    G_PROFILE_SHADED(sh, r0 - l0);
+    G_PROFILE_STAGE(kShade_Stage);
+    shade_row(sh, l0, y, r0 - l0, row);
+  }
+
+  clip.clipRow(y, l0, r0, [&](int l, int r) {
+    G_PROFILE_SPAN(r - l);
+    G_PROFILE_STAGE(kBlend_Stage);
+    blend_shader_row(bm, row + (l - l0), l, y, r - l, blend);
+  });
+}
+
+// Blend an offscreen layer into bm with its top-left at (left, top), after scaling it by the
+// paint's alpha
+template <typename Device> void composite_layer(const Device& bm, const DeviceClip& clip, const Device& layer, int left, int top, const GPaint& paint) {
+  if (layer.width() == 0 || layer.height() == 0) return;
+
+  auto blend = DeviceTraits<Device>::proc(paint.getBlendMode());
+  float alpha = GPinToUnit(paint.getAlpha());
+
+  typename DeviceTraits<Device>::Pixel scaled[layer.width()];
+
+  for (int y = 0; y < layer.height(); y++) {
+    auto row = layer.getAddr(0, y);
+
+    if (alpha < 1) {
+      scale_row(row, scaled, layer.width(), alpha);
+      row = scaled;
+    }
+
+    clip.clipRow(top + y, left, left + layer.width(), [&](int l, int r) {
+      blend_shader_row(bm, row + (l - left), l, top + y, r - l, blend);
+    });
+  }
+}
+
+// A new layer starts transparent, except on an opaque (565) device, which cannot store
+// transparency: there it starts as a copy of what it covers in the parent.
+template <typename Device> void init_layer(const Device& layer, const Device& parent, int left, int top) {}
+
+void init_layer(const GBitmap565& layer, const GBitmap565& parent, int left, int top) {
+  for (int y = 0; y < layer.height(); y++) {
+    memcpy(layer.getAddr(0, y), parent.getAddr(left, top + y), layer.width() * sizeof(GPixel565));
+  }
+}
+
+// Since the layer already holds its backdrop, compositing is a lerp back towards the parent
+// by the paint's alpha. For srcOver that matches compositing a transparent layer exactly; other
+// paint modes are treated as srcOver.
+void composite_layer(const GBitmap565& bm, const DeviceClip& clip, const GBitmap565& layer, int left, int top, const GPaint& paint) {
+  int a = GRoundToInt(GPinToUnit(paint.getAlpha()) * 255);
+  auto lerp = [a](int s, int d) { return GDiv255(a * s + (255 - a) * d); };
+
+  for (int y = 0; y < layer.height(); y++) {
+    const GPixel565* row = layer.getAddr(0, y);
+
+    clip.clipRow(top + y, left, left + layer.width(), [&](int l, int r) {
+      GPixel565* pixel = bm.getAddr(l, top + y);
+      const GPixel565* src = row + (l - left);
+
+      if (a == 255) {
+        memcpy(pixel, src, (r - l) * sizeof(GPixel565));
+        return;
+      }
+      for (int i = 0; i < r - l; i++) {
+        GPixel s = GPixel565_ToPixel(src[i]);
+        GPixel d = GPixel565_ToPixel(pixel[i]);
+        pixel[i] = GPixel565_FromPixel(GPixel_PackARGB(255, lerp(GPixel_GetR(s), GPixel_GetR(d)),
+                                                       lerp(GPixel_GetG(s), GPixel_GetG(d)),
+                                                       lerp(GPixel_GetB(s), GPixel_GetB(d))));
+      }
+    });
+  }
+}
+
 // DRAW SHAPES
 
+// Visits the pixels of a hairline from a to b (already clipped to the clip bounds), one pixel
+// per step along the major axis, with the minor coordinate stepped in 16.16 fixed point.
+template <typename Plot> void walk_hairline(const DeviceClip& clip, GPoint a, GPoint b, Plot plot) {
+  bool xMajor = std::abs(b.x - a.x) >= std::abs(b.y - a.y);
+
+  if (!xMajor) {
+    std::swap(a.x, a.y);
+    std::swap(b.x, b.y);
+  }
+
+  int start = GRoundToInt(a.x);
+  int stop = GRoundToInt(b.x);
+  if (start == stop) return;
+
+  int step = start < stop ? 1 : -1;
+  float slope = (b.y - a.y) / (b.x - a.x);
+
+  // minor coordinate at the center of the first pixel along the major axis
+  float center = start + (step > 0 ? 0.5f : -0.5f);
+  GFixed minor = float_to_fixed(a.y + slope * (center - a.x));
+  GFixed dminor = float_to_fixed(slope * step);
+
+  for (int i = start; i != stop; i += step) {
+    int major = step > 0 ? i : i - 1;
+    int m = fixed_floor(minor);
+
+    int x = xMajor ? major : m;
+    int y = xMajor ? m : major;
+
+    if (clip.contains(x, y)) plot(x, y);
+
+    minor += dminor;
+  }
+}
+
+// Blend src into the single pixel at (x, y)
+template <typename Device, typename Pixel, typename Proc>
+void blend_pixel(const Device& bm, int x, int y, const Pixel& src, Proc blend) {
+  auto pixel = bm.getAddr(x, y);
+  *pixel = blend(src, *pixel);
+}
+
+void blend_pixel(const GBitmap565& bm, int x, int y, const GPixel& src, BlendProc blend) {
+  GPixel565* pixel = bm.getAddr(x, y);
+  *pixel = GPixel565_FromPixel(blend(src, GPixel565_ToPixel(*pixel)));
+}
+
+template <typename Device, typename Pixel, typename Proc>
+void draw_hairline(const Device& bm, const DeviceClip& clip, GPoint a, GPoint b, const Pixel& src, Proc blend) {
+  walk_hairline(clip, a, b, [&](int x, int y) {
+    blend_pixel(bm, x, y, src, blend);
+  });
+}
+
+template <typename Device, typename Proc>
+void shade_hairline(const Device& bm, const DeviceClip& clip, GPoint a, GPoint b, GShader* sh, Proc blend) {
+  walk_hairline(clip, a, b, [&](int x, int y) {
+    typename DeviceTraits<Device>::Pixel src;
+    shade_row(sh, x, y, 1, &src);
+
+    blend_pixel(bm, x, y, src, blend);
+  });
+}
+
 void blend_sect(const GIRect sect, const GBitmap& bm, const GPixel& src, BlendProc blend) {
   if (sect.left >= bm.width()) return;
 
@@ -186,28 +597,33 @@ void blend_sect(const GIRect sect, const GBitmap& bm, const GPixel& src, BlendPr
   }
 }
 
-void fill_convex_polygon(const GBitmap& bm, std::vector<Segment> &segments, GPixel src, BlendProc blend) {
-  Segment& a = segments[segments.size() - 1];
-  Segment& b = segments[segments.size() - 2];
+template <typename Device, typename Pixel, typename Proc>
+void fill_convex_polygon(const Device& bm, const DeviceClip& clip, std::vector<Segment> &segments, Pixel src, Proc blend) {
+  // segments are sorted with the first to start at the back: take a and b off the back, and
+  // each one that ends is replaced by the next. (Indexing from the end instead read past the
+  // front once only one edge was left.)
+  Segment a = segments.back();
+  segments.pop_back();
+  Segment b = segments.back();
+  segments.pop_back();
 
   bool isALeft = a.x < b.x;
 
   for (int y = a.top; y < bm.height(); y++) {
     if (!b.isInbounds(y)) {
-      segments.erase(segments.end() - 2);
-      if (segments.size() <= 1) return;
+      if (segments.empty()) return;
 
-      b = segments[segments.size() - 2];
+      b = segments.back();
+      segments.pop_back();
 
       isALeft = a.x < b.x;
     }
 
     if (!a.isInbounds(y)) {
-      segments.erase(segments.end() - 1);
+      if (segments.empty()) return;
 
-      if (segments.size() <= 0) return;
-
-      a = segments[segments.size() - 2];
+      a = segments.back();
+      segments.pop_back();
 
       isALeft = a.x < b.x;
     }
@@ -223,33 +639,36 @@ void fill_convex_polygon(const GBitmap& bm, std::vector<Segment> &segments, GPix
 
     // assert(start >= 0 && end >= start);
 
-    if (start < bm.width()) blend_row(bm, src, start, y, (end - start), blend);
+    if (start < bm.width()) blit_row(bm, clip, src, start, y, (end - start), blend);
   }
 }
 
-void shade_fill_convex_polygon(const GBitmap& bm, std::vector<Segment> &segments, GShader* sh, BlendProc blend) {
+template <typename Device, typename Proc>
+void shade_fill_convex_polygon(const Device& bm, const DeviceClip& clip, std::vector<Segment> &segments, GShader* sh, Proc blend) {
 
-  Segment& a = segments[segments.size() - 1];
-  Segment& b = segments[segments.size() - 2];
+  // as in fill_convex_polygon
+  Segment a = segments.back();
+  segments.pop_back();
+  Segment b = segments.back();
+  segments.pop_back();
 
   bool isALeft = a.x < b.x;
 
   for (int y = a.top; y < bm.height(); y++) {
     if (!b.isInbounds(y)) {
-      segments.erase(segments.end() - 2);
-      if (segments.size() <= 1) return;
+      if (segments.empty()) return;
 
-      b = segments[segments.size() - 2];
+      b = segments.back();
+      segments.pop_back();
 
       isALeft = a.x < b.x;
     }
 
     if (!a.isInbounds(y)) {
-      segments.erase(segments.end() - 1);
-
-      if (segments.size() <= 0) return;
+      if (segments.empty()) return;
 
-      a = segments[segments.size() - 2];
+      a = segments.back();
+      segments.pop_back();
 
       isALeft = a.x < b.x;
     }
@@ -265,11 +684,7 @@ void shade_fill_convex_polygon(const GBitmap& bm, std::vector<Segment> &segments
 
     // assert(start >= 0 && end >= start);
 
-    if (start < bm.width()) {
-      GPixel row[end - start];
-      sh->shadeRow(start, y, (end - start), row);
-      blend_shader_row(bm, row, start, y, (end - start), blend);
-    }
+    if (start < bm.width()) blit_shader_row(bm, clip, sh, start, y, (end - start), blend);
   }
 }
 
@@ -285,97 +700,102 @@ struct XComparator {
   bool operator() (const Segment& p0, const Segment& p1) const { return p0.x > p1.x; }
 };
 
-void fill_path(const GBitmap& bm, std::vector<Segment> segments, const GPixel& src, BlendProc blend) {
-  assert(segments.size() > 0);
-
-  int yMin = segments[segments.size() - 1].top;
-
-  for (int y = yMin; y < bm.height(); y++) {
-    if (segments.size() == 0) break;
-
-    size_t i = 0;
-    int l = 0;
-    int r = 0;
-    int fill = 0;
-
-    Segment* e = &(segments[segments.size() - i - 1]);
-
-    while (i < segments.size() && e->isInbounds(y)) {
-      int x = GRoundToInt(e->getIntersect());
-
-      if (fill == 0) l = x;
-
-      fill += e->winding;
+// A horizontal run [left, right) on a single row
+struct Span {
+  int left, right;
+};
 
-      if (fill == 0 && l < bm.width()) {
-        r = x;
-        blend_row(bm, src, l, y, (r - l), blend);
-      }
+// Spans arrive left to right; one that touches or overlaps the previous run is merged
+// into it, so abutting contours cost a single blend call instead of several.
+void add_span(std::vector<Span> &spans, int l, int r) {
+  if (r <= l) return;
 
-      if (e->isInbounds(y + 1)) {
-        e->nextIntersect();
-        i += 1;
-      } else {
-        segments.erase(segments.end() - i - 1);
-      }
-
-      e = &(segments[segments.size() - i - 1]);
-    }
+  if (spans.size() > 0 && l <= spans.back().right) {
+    spans.back().right = std::max(spans.back().right, r);
+  } else {
+    spans.push_back({ l, r });
+  }
+}
 
-    // assert(fill == 0);
+// Fill rules for the path scan. They are template parameters so that the inside test in
+// the scan loop never branches on the path's fill type.
+template <bool EvenOdd, bool Inverse> struct FillRule {
+  static constexpr bool kInverse = Inverse;
 
-    if (segments.size() == 0) break;
+  static bool contains(int fill) { return EvenOdd ? (fill & 1) != 0 : fill != 0; }
+};
 
-    while (i < segments.size() && segments[segments.size() - i - 1].isInbounds(y + 1)) {
-      i++;
-    }
+// Writes into dst the parts of [0, width) that the (sorted, disjoint) spans do not cover
+void invert_spans(const std::vector<Span> &spans, std::vector<Span> &dst, int width) {
+  dst.clear();
 
-    std::sort(segments.end() - i, segments.end(), XComparator());
+  int l = 0;
+  for (const Span& span : spans) {
+    add_span(dst, l, span.left);
+    l = span.right;
   }
+  add_span(dst, l, width);
 }
 
-void shade_fill_path(const GBitmap& bm, std::vector<Segment> segments, GShader* sh, BlendProc blend) {
-  assert(segments.size() > 0);
+// Walks the segments top to bottom, handing each row's merged spans to blit(y, spans).
+// Inverse rules visit every row of the device, since rows the path misses are fully inside.
+template <typename Rule, typename Device, typename Blit> void scan_path(const Device& bm, std::vector<Segment> &segments, Blit blit) {
+  int yMin = segments.size() > 0 ? segments[segments.size() - 1].top : bm.height();
+  if (Rule::kInverse) yMin = 0;
 
-  int yMin = segments[segments.size() - 1].top;
+  std::vector<Span> spans;
+  std::vector<Span> inverse;
 
   for (int y = yMin; y < bm.height(); y++) {
-    if (segments.size() == 0) break;
+    if (segments.size() == 0 && !Rule::kInverse) break;
+
+    spans.clear();
 
+    // The active edges are at the back. Those that go on to the next row are packed toward the
+    // back as we go (keeping their order), and the ones that ended are erased in one go: erasing
+    // each as it ends shifts the whole active list every time, which is quadratic in the edges.
+    const size_t n = segments.size();
     size_t i = 0;
+    size_t kept = 0;
     int l = 0;
-    int r = 0;
     int fill = 0;
 
-    Segment* e = &(segments[segments.size() - i - 1]);
+    while (i < n) {
+      Segment* e = &(segments[n - i - 1]);
+      if (!e->isInbounds(y)) break;
 
-    while (i < segments.size() && e->isInbounds(y)) {
-      int x = GRoundToInt(e->getIntersect());
-
-      if (fill == 0) l = x;
+      int x = e->getIntersect();
 
+      bool wasInside = Rule::contains(fill);
       fill += e->winding;
+      bool isInside = Rule::contains(fill);
 
-      if (fill == 0 && l < bm.width()) {
-        r = x;
-        GPixel row[r - l];
-        sh->shadeRow(l, y, (r - l), row);
-        blend_shader_row(bm, row, l, y, (r - l), blend);
+      if (!wasInside && isInside) {
+        l = x;
+      } else if (wasInside && !isInside && l < bm.width()) {
+        add_span(spans, l, x);
       }
 
       if (e->isInbounds(y + 1)) {
         e->nextIntersect();
-        i += 1;
-      } else {
-        segments.erase(segments.end() - i - 1);
+        segments[n - kept - 1] = *e;
+        kept += 1;
       }
-
-      e = &(segments[segments.size() - i - 1]);
+      i += 1;
     }
+    segments.erase(segments.end() - i, segments.end() - kept);
+    i = kept;
 
     // assert(fill == 0);
 
-    if (segments.size() == 0) break;
+    if (Rule::kInverse) {
+      invert_spans(spans, inverse, bm.width());
+      blit(y, inverse);
+    } else {
+      blit(y, spans);
+    }
+
+    if (segments.size() == 0) continue;
 
     while (i < segments.size() && segments[segments.size() - i - 1].isInbounds(y + 1)) {
       i++;
@@ -385,3 +805,39 @@ void shade_fill_path(const GBitmap& bm, std::vector<Segment> segments, GShader*
   }
 }
 
+template <typename Device, typename Blit> void scan_path(const Device& bm, std::vector<Segment> &segments, GPath::FillType type, Blit blit) {
+  switch (type) {
+    case GPath::kWinding_FillType:
+      scan_path<FillRule<false, false>>(bm, segments, blit);
+      break;
+    case GPath::kEvenOdd_FillType:
+      scan_path<FillRule<true, false>>(bm, segments, blit);
+      break;
+    case GPath::kInverseWinding_FillType:
+      scan_path<FillRule<false, true>>(bm, segments, blit);
+      break;
+    case GPath::kInverseEvenOdd_FillType:
+      scan_path<FillRule<true, true>>(bm, segments, blit);
+      break;
+  }
+}
+
+template <typename Device, typename Pixel, typename Proc>
+void fill_path(const Device& bm, const DeviceClip& clip, std::vector<Segment> segments, const Pixel& src, Proc blend,
+               GPath::FillType type = GPath::kWinding_FillType) {
+  scan_path(bm, segments, type, [&](int y, const std::vector<Span> &spans) {
+    for (const Span& span : spans) {
+      blit_row(bm, clip, src, span.left, y, span.right - span.left, blend);
+    }
+  });
+}
+
+template <typename Device, typename Proc>
+void shade_fill_path(const Device& bm, const DeviceClip& clip, std::vector<Segment> segments, GShader* sh, Proc blend,
+                     GPath::FillType type = GPath::kWinding_FillType) {
+  scan_path(bm, segments, type, [&](int y, const std::vector<Span> &spans) {
+    for (const Span& span : spans) {
+      blit_shader_row(bm, clip, sh, span.left, y, span.right - span.left, blend);
+    }
+  });
+}
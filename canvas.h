@@ -5,20 +5,37 @@
 #include "include/GRect.h"
 #include "include/GColor.h"
 #include "include/GBitmap.h"
+#include "include/GPixelF.h"
+#include "include/GPixelCompact.h"
+#include "include/GPaint.h"
+#include "clipMask.h"
+#include "layerPool.h"
 #include <iostream>
 
-class MyCanvas : public GCanvas {
+template <typename Device> struct DeviceTraits;
+
+// Device is GBitmap, or GBitmapF for the float canvas, or GBitmapA8 / GBitmap565 for the compact ones
+template <typename Device> class MyCanvasT : public GCanvas {
   public:
-    MyCanvas(const GBitmap& device) : fDevice(device), ctm({ GMatrix() }) {}
+    MyCanvasT(const Device& device)
+      : fDevice(device), ctm({ GMatrix() }), clips({ { GIRect::WH(device.width(), device.height()), nullptr } }) {}
 
     void save() override;
+    void saveLayer(const GRect* bounds, const GPaint&) override;
     void restore() override;
     void concat(const GMatrix& matrix) override;
 
+    void clipRect(const GRect&) override;
+    void clipPath(const GPath&) override;
+
+    GIRect getDamage() const override { return fDamage; }
+    void resetDamage() override { fDamage = GIRect::LTRB(0, 0, 0, 0); }
+
     void clear(const GColor& color) override;
 
     void drawRect(const GRect&, const GPaint&) override;
     void drawConvexPolygon(const GPoint[], int count, const GPaint&) override;
+    void drawPolyline(const GPoint[], int count, const GPaint&) override;
 
     void drawPath(const GPath& path, const GPaint&) override;
 
@@ -32,8 +49,33 @@ class MyCanvas : public GCanvas {
                           int level, const GPaint&) override;
 
   private:
-    const GBitmap fDevice;
+    typedef DeviceTraits<Device> Traits;
+    typedef typename Traits::Pixel Pixel;
+
+    // an offscreen layer, and what to restore when it is composited back
+    struct Layer {
+      Device parent;
+      GIRect bounds;      // where the layer lands in parent
+      GPaint paint;
+      size_t depth;       // ctm.size() while the layer is current
+    };
+
+    Device fDevice;       // the bitmap or layer currently drawn into
     std::vector<GMatrix> ctm {};
+    // saved and restored alongside ctm
+    std::vector<DeviceClip> clips {};
+    std::vector<Layer> layers {};
+    LayerPool<Device> fLayerPool;
+
+    // union of the device bounds drawn to since the last resetDamage()
+    GIRect fDamage = GIRect::LTRB(0, 0, 0, 0);
+
+    void addDamage(const GIRect& bounds);
 };
 
+typedef MyCanvasT<GBitmap> MyCanvas;
+typedef MyCanvasT<GBitmapF> MyCanvasF;
+typedef MyCanvasT<GBitmapA8> MyCanvasA8;
+typedef MyCanvasT<GBitmap565> MyCanvas565;
+
 #endif
\ No newline at end of file
@@ -0,0 +1,100 @@
+#ifndef _g_clip_mask_h_
+#define _g_clip_mask_h_
+
+#include "include/GRect.h"
+#include <memory>
+#include <vector>
+
+// Coverage of a complex (path) clip: one byte per pixel of fBounds, 0 or 0xFF
+class ClipMask {
+  public:
+    ClipMask(const GIRect& bounds) : fBounds(bounds), fCoverage(bounds.width() * bounds.height(), 0) {}
+
+    // a copy of src moved by (dx, dy)
+    ClipMask(const ClipMask& src, int dx, int dy) : fBounds(src.fBounds.offset(dx, dy)), fCoverage(src.fCoverage) {}
+
+    const GIRect& bounds() const { return fBounds; }
+
+    bool contains(int x, int y) const {
+      if (x < fBounds.left || x >= fBounds.right || y < fBounds.top || y >= fBounds.bottom) return false;
+      return this->row(y)[x - fBounds.left] != 0;
+    }
+
+    // mark [l, r) on row y as inside; the caller keeps the run within the bounds
+    void fill(int y, int l, int r) {
+      memset(this->row(y) + (l - fBounds.left), 0xFF, r - l);
+    }
+
+    // calls proc(left, right) for every covered run within [l, r) on row y
+    template <typename Proc> void forEachRun(int y, int l, int r, Proc proc) const {
+      if (y < fBounds.top || y >= fBounds.bottom) return;
+
+      l = std::max(l, fBounds.left);
+      r = std::min(r, fBounds.right);
+
+      const uint8_t* cov = this->row(y) - fBounds.left;
+
+      int x = l;
+      while (x < r) {
+        while (x < r && !cov[x]) x++;
+        int start = x;
+        while (x < r && cov[x]) x++;
+
+        if (x > start) proc(start, x);
+      }
+    }
+
+  private:
+    GIRect fBounds;
+    std::vector<uint8_t> fCoverage;
+
+    uint8_t* row(int y) { return fCoverage.data() + (y - fBounds.top) * fBounds.width(); }
+    const uint8_t* row(int y) const { return fCoverage.data() + (y - fBounds.top) * fBounds.width(); }
+};
+
+// The clip in device space. Rect clips only shrink the bounds (and are applied while edges
+// are built); path clips also keep a mask, shared between save levels until clipped again.
+struct DeviceClip {
+  GIRect bounds;
+  std::shared_ptr<const ClipMask> mask;
+
+  bool isEmpty() const { return bounds.isEmpty(); }
+
+  bool contains(int x, int y) const {
+    if (x < bounds.left || x >= bounds.right || y < bounds.top || y >= bounds.bottom) return false;
+    return !mask || mask->contains(x, y);
+  }
+
+  // calls blit(left, right) for every part of [l, r) on row y that survives the clip
+  template <typename Blit> void clipRow(int y, int l, int r, Blit blit) const {
+    if (y < bounds.top || y >= bounds.bottom) return;
+
+    l = std::max(l, bounds.left);
+    r = std::min(r, bounds.right);
+    if (l >= r) return;
+
+    if (mask) {
+      mask->forEachRun(y, l, r, blit);
+    } else {
+      blit(l, r);
+    }
+  }
+};
+
+GIRect intersect(const GIRect& a, const GIRect& b) {
+  GIRect r = GIRect::LTRB(std::max(a.left, b.left), std::max(a.top, b.top),
+                          std::min(a.right, b.right), std::min(a.bottom, b.bottom));
+
+  return r.isEmpty() ? GIRect::LTRB(0, 0, 0, 0) : r;
+}
+
+// smallest rect containing both; an empty rect adds nothing
+GIRect join(const GIRect& a, const GIRect& b) {
+  if (a.isEmpty()) return b;
+  if (b.isEmpty()) return a;
+
+  return GIRect::LTRB(std::min(a.left, b.left), std::min(a.top, b.top),
+                      std::max(a.right, b.right), std::max(a.bottom, b.bottom));
+}
+
+#endif
@@ -14,8 +14,60 @@ GIRect clip_rect(const GRect& rect, const GBitmap& bitmap) {
   return GIRect::LTRB(startX, startY, endX, endY);
 }
 
+// Beyond this, coordinates are past what a float can place within a pixel, and rounding them
+// (nearer 2^31) overflows an int, so clip_segment() first cuts such a segment down in double.
+const float kMaxCoord = 1 << 24;
+
+bool clip_segment(const GIRect& clip, std::vector<Segment> &segments, GPoint p0, GPoint p1);
+
+// Cuts the segment to the clip's rows (give or take one), and folds what lies beyond its left
+// or right side onto that side, as clip_segment() would, so every piece left is small enough
+// to hand back to it. Non-finite segments are dropped.
+bool clip_huge_segment(const GIRect& clip, std::vector<Segment> &segments, GPoint p0, GPoint p1) {
+  if (!std::isfinite(p0.x) || !std::isfinite(p0.y) || !std::isfinite(p1.x) || !std::isfinite(p1.y)) {
+    return false;
+  }
+
+  const double x0 = p0.x, y0 = p0.y, dx = (double) p1.x - p0.x, dy = (double) p1.y - p0.y;
+  if (dy == 0) return false;
+
+  // rows outside the clip add nothing
+  double tTop = (clip.top - 1 - y0) / dy;
+  double tBottom = (clip.bottom + 1 - y0) / dy;
+  double ts[4] = { std::max(0.0, std::min(tTop, tBottom)), 0, 0, 0 };
+  double tEnd = std::min(1.0, std::max(tTop, tBottom));
+  if (ts[0] >= tEnd) return false;
+
+  // split where it crosses the columns just outside the clip
+  int n = 1;
+  if (dx != 0) {
+    for (double x : { clip.left - 1.0, clip.right + 1.0 }) {
+      double t = (x - x0) / dx;
+      if (t > ts[0] && t < tEnd) ts[n++] = t;
+    }
+  }
+  ts[n++] = tEnd;
+  std::sort(ts, ts + n);
+
+  bool added = false;
+  for (int i = 0; i + 1 < n; i++) {
+    GPoint a, b;
+    for (auto [t, p] : { std::make_pair(ts[i], &a), std::make_pair(ts[i + 1], &b) }) {
+      double x = std::max(clip.left - 1.0, std::min(clip.right + 1.0, x0 + dx * t));
+      *p = { (float) x, (float) (y0 + dy * t) };
+    }
+    added |= clip_segment(clip, segments, a, b);
+  }
+  return added;
+}
+
 // returns whether or not at least one segment was added
-bool clip_segment(const GBitmap& bm, std::vector<Segment> &segments, GPoint p0, GPoint p1) {
+bool clip_segment(const GIRect& clip, std::vector<Segment> &segments, GPoint p0, GPoint p1) {
+  // also catches NaN
+  if (!(std::max(std::max(fabsf(p0.x), fabsf(p0.y)), std::max(fabsf(p1.x), fabsf(p1.y))) <= kMaxCoord)) {
+    return clip_huge_segment(clip, segments, p0, p1);
+  }
+
   // eliminate horizontal segments
   if (GRoundToInt(p0.y) == GRoundToInt(p1.y)) return false;
 
@@ -30,16 +82,16 @@ bool clip_segment(const GBitmap& bm, std::vector<Segment> &segments, GPoint p0,
   assert(p0.y < p1.y);
 
   // eliminate segments vertically out of bounds
-  if (GRoundToInt(p1.y) <= 0 || GRoundToInt(p0.y) >= bm.height()) return false;
+  if (GRoundToInt(p1.y) <= clip.top || GRoundToInt(p0.y) >= clip.bottom) return false;
 
-  if (is_segment_contained(bm, p0, p1)) {
+  if (is_segment_contained(clip, p0, p1)) {
     // std::cout << "inserting at " << p0.x << ", " << p0.y << " -> " << p1.x << ", " << p1.y << " swapped: " << swapped << std::endl;
     insert_segment(segments, p0, p1, swapped);
     return true; 
   }
 
-  p0 = get_top_point(p0, p1, 0.0f);
-  p1 = get_bottom_point(p0, p1, (float) bm.height());
+  p0 = get_top_point(p0, p1, (float) clip.top);
+  p1 = get_bottom_point(p0, p1, (float) clip.bottom);
 
   if (p0.x > p1.x) {
     std::swap(p0, p1);
@@ -47,19 +99,20 @@ bool clip_segment(const GBitmap& bm, std::vector<Segment> &segments, GPoint p0,
   }
   assert(p0.x <= p1.x);
 
-  if (p0.x >= bm.width()) {
+  if (p0.x >= clip.right) {
     // std::cout << "inserting at " << bm.width() << ", " << p0.y << " -> " << bm.width() << ", " << p1.y << " swapped: " << swapped << std::endl;
-    insert_segment(segments, { (float) bm.width(), p0.y }, { (float) bm.width(), p1.y }, swapped);
-  } else if (p1.x <= 0.0f) {
+    insert_segment(segments, { (float) clip.right, p0.y }, { (float) clip.right, p1.y }, swapped);
+  } else if (p1.x <= clip.left) {
     // std::cout << "inserting at " << 0.0f << ", " << p0.y << " -> " << 0.0f << ", " << p1.y << " swapped: " << swapped << std::endl;
-    insert_segment(segments, { 0.0f, p0.y }, { 0.0f, p1.y }, swapped);
+    insert_segment(segments, { (float) clip.left, p0.y }, { (float) clip.left, p1.y }, swapped);
   } else {
-    GPoint left = get_left_point(p0, p1, 0.0f);
-    GPoint right = get_right_point(p0, p1, (float) bm.width());
+    GPoint left = get_left_point(p0, p1, (float) clip.left);
+    GPoint right = get_right_point(p0, p1, (float) clip.right);
 
     if (GRoundToInt(left.y) != GRoundToInt(right.y)) insert_segment(segments, left, right, swapped);
 
-    int winding = segments[segments.size() - 1].winding;
+    // the winding the middle piece has (or would have, if it rounded away)
+    int winding = (swapped ? right.y < left.y : left.y < right.y) ? 1 : -1;
 
     if (winding > 0) {
       if (GRoundToInt(left.y) != GRoundToInt(p0.y)) segments.push_back(Segment(left, { left.x, p0.y }));
@@ -74,61 +127,203 @@ bool clip_segment(const GBitmap& bm, std::vector<Segment> &segments, GPoint p0,
   return true;
 }
 
-void clip_quad_curve(const GBitmap& bm, std::vector<Segment> &segments, GPoint a, GPoint b, GPoint c) {
-  float eX = (a.x - (2 * b.x) + c.x) / 4;
-  float eY = (a.y - (2 * b.y) + c.y) / 4;
-  float eLen = sqrt(eX * eX + eY * eY);
+// Liang-Barsky: trims the line a-b to the clip bounds, returning false if nothing is left
+bool clip_line(const GIRect& clip, GPoint& a, GPoint& b) {
+  float t0 = 0.0f;
+  float t1 = 1.0f;
+
+  GVector d = b - a;
+
+  // for each side: p * t <= q keeps the point inside
+  const float p[4] = { -d.x, d.x, -d.y, d.y };
+  const float q[4] = { a.x - clip.left, clip.right - a.x, a.y - clip.top, clip.bottom - a.y };
+
+  for (int i = 0; i < 4; i++) {
+    if (p[i] == 0.0f) {
+      if (q[i] < 0.0f) return false;
+      continue;
+    }
+
+    float t = q[i] / p[i];
+
+    if (p[i] < 0.0f) {
+      t0 = std::max(t0, t);
+    } else {
+      t1 = std::min(t1, t);
+    }
+  }
+
+  if (t0 > t1) return false;
+
+  GPoint start = a + d * t0;
+  b = a + d * t1;
+  a = start;
+
+  return true;
+}
+
+// A curve is flattened into at most this many lines. One that needs more (its control points
+// are far out) is chopped in half until it doesn't. A piece that still needs more after this
+// many chops is beyond what floats can resolve, and is drawn as its chord.
+const int kMaxCurveSegments = 1 << 10;
+const int kMaxCurveChops = 24;
+
+// A curve whose control points all lie beyond one side of the clip fills the same pixels as the
+// line between its ends: only the rows it spans (and their direction) matter.
+bool curve_misses_clip(const GIRect& clip, const GPoint pts[], int count) {
+  GRect r = points_bounds(pts, count);
+  return r.right <= clip.left || r.left >= clip.right || r.bottom <= clip.top || r.top >= clip.bottom;
+}
+
+// Halfway between p and q, without overflowing when both are near FLT_MAX.
+GPoint half_way(GPoint p, GPoint q) { return p * 0.5f + q * 0.5f; }
+
+// GPath::ChopQuadAt/ChopCubicAt at t = 1/2, by midpoints only, so curves with control points
+// anywhere a float reaches can be chopped.
+void chop_quad_in_half(const GPoint src[3], GPoint dst[5]) {
+  dst[0] = src[0];
+  dst[1] = half_way(src[0], src[1]);
+  dst[3] = half_way(src[1], src[2]);
+  dst[2] = half_way(dst[1], dst[3]);
+  dst[4] = src[2];
+}
+
+void chop_cubic_in_half(const GPoint src[4], GPoint dst[7]) {
+  GPoint bc = half_way(src[1], src[2]);
+  dst[0] = src[0];
+  dst[1] = half_way(src[0], src[1]);
+  dst[5] = half_way(src[2], src[3]);
+  dst[2] = half_way(dst[1], bc);
+  dst[4] = half_way(bc, dst[5]);
+  dst[3] = half_way(dst[2], dst[4]);
+  dst[6] = src[3];
+}
+
+void clip_quad_curve(const GIRect& clip, std::vector<Segment> &segments, GPoint a, GPoint b, GPoint c, int chops = 0) {
+  GPoint src[3] = { a, b, c };
+  if (curve_misses_clip(clip, src, 3)) {
+    clip_segment(clip, segments, a, c);
+    return;
+  }
+
+  // in double, so a finite curve (even one with control points near FLT_MAX) can't overflow:
+  // only a NaN, from a point at infinity, has no count, and then the chord is all there is
+  double eX = ((double) a.x - 2.0 * b.x + c.x) / 4;
+  double eY = ((double) a.y - 2.0 * b.y + c.y) / 4;
+  double eLen = sqrt(eX * eX + eY * eY);
 
-  int num_segs = (int) ceil(sqrt(eLen * 4));
+  double segs = ceil(sqrt(eLen * 4));
+  if (std::isnan(segs)) {
+    clip_segment(clip, segments, a, c);
+    return;
+  }
+
+  GPoint dst[5];
+  if (segs > kMaxCurveSegments) {
+    if (chops == kMaxCurveChops) {
+      clip_segment(clip, segments, a, c);
+      return;
+    }
+    chop_quad_in_half(src, dst);
+    clip_quad_curve(clip, segments, dst[0], dst[1], dst[2], chops + 1);
+    clip_quad_curve(clip, segments, dst[2], dst[3], dst[4], chops + 1);
+    return;
+  }
+
+  // a curve that is really a line (segs == 0) is still one line
+  int num_segs = std::max(1, (int) segs);
   float dt = 1.0f / num_segs;
 
   GPoint prev = a;
   GPoint curr;
-  GPoint src[3] = { a, b, c };
-  GPoint dst[5];
 
   for (float i = 0.0f; i <= 1.0f; i += dt) {
     GPath::ChopQuadAt(src, dst, i);
 
     curr = dst[2];
-    clip_segment(bm, segments, prev, curr);
+    clip_segment(clip, segments, prev, curr);
 
     prev = curr;
   }
 }
 
-void clip_cubic_curve(const GBitmap& bm, std::vector<Segment> &segments, GPoint a, GPoint b, GPoint c, GPoint d) {
-  GPoint e0 = a - (2 * b) + c;
-  GPoint e1 = b - (2 * c) + d;
+void clip_cubic_curve(const GIRect& clip, std::vector<Segment> &segments, GPoint a, GPoint b, GPoint c, GPoint d, int chops = 0) {
+  GPoint src[4] = { a, b, c, d };
+  if (curve_misses_clip(clip, src, 4)) {
+    clip_segment(clip, segments, a, d);
+    return;
+  }
+
+  // in double, as in clip_quad_curve
+  double eX = std::max(fabs((double) a.x - 2.0 * b.x + c.x), fabs((double) b.x - 2.0 * c.x + d.x));
+  double eY = std::max(fabs((double) a.y - 2.0 * b.y + c.y), fabs((double) b.y - 2.0 * c.y + d.y));
+  double eLen = sqrt(eX * eX + eY * eY);
 
-  GPoint e;
-  e.x = std::max(abs(e0.x), abs(e1.x));
-  e.y = std::max(abs(e0.y), abs(e1.y));
-  
-  float eLen = sqrt(e.x * e.x + e.y * e.y);
+  double segs = ceil(sqrt((3 * eLen) * 16));
+  if (std::isnan(segs)) {
+    clip_segment(clip, segments, a, d);
+    return;
+  }
+
+  GPoint dst[7];
+  if (segs > kMaxCurveSegments) {
+    if (chops == kMaxCurveChops) {
+      clip_segment(clip, segments, a, d);
+      return;
+    }
+    chop_cubic_in_half(src, dst);
+    clip_cubic_curve(clip, segments, dst[0], dst[1], dst[2], dst[3], chops + 1);
+    clip_cubic_curve(clip, segments, dst[3], dst[4], dst[5], dst[6], chops + 1);
+    return;
+  }
 
-  int num_segs = (int) ceil(sqrt((3 * eLen) * 16));
+  // a curve that is really a line (segs == 0) is still one line
+  int num_segs = std::max(1, (int) segs);
   float dt = 1.0f / num_segs;
 
   GPoint prev = a;
   GPoint curr;
-  GPoint src[4] = { a, b, c, d };
-  GPoint dst[7];
 
   for (float i = 0.0f; i <= 1.0f; i += dt) {
     GPath::ChopCubicAt(src, dst, i);
 
     curr = dst[3];
-    clip_segment(bm, segments, prev, curr);
+    clip_segment(clip, segments, prev, curr);
 
     prev = curr;
   }
 }
 
-void pts_to_segments(const GBitmap& bm, std::vector<Segment> &segments, const GPoint* pts, int count) {
+void pts_to_segments(const GIRect& clip, std::vector<Segment> &segments, const GPoint* pts, int count) {
   for (int i = 0; i < count; i++) {
     int j = (i + 1) % count;
-    clip_segment(bm, segments, pts[i], pts[j]);
+    clip_segment(clip, segments, pts[i], pts[j]);
+  }
+}
+
+// Handle quadratic and cubic curves in the path when clipping
+// Draw curves with a tolerance of 1/4 pixel
+void path_to_segments(const GIRect& clip, std::vector<Segment> &segments, const GPath& path) {
+  GPoint pts[GPath::kMaxNextPoints];
+  GPath::Edger iter(path);
+
+  while (auto v = iter.next(pts)) {
+    switch (v.value()) {
+      case GPath::kLine: // pts[0..1]
+        clip_segment(clip, segments, pts[0], pts[1]);
+        break;
+
+      case GPath::kQuad: // pts[0..2]
+        clip_quad_curve(clip, segments, pts[0], pts[1], pts[2]);
+        break;
+
+      case GPath::kCubic: // pts[0..3]
+        clip_cubic_curve(clip, segments, pts[0], pts[1], pts[2], pts[3]);
+        break;
+
+      default:
+        break;
+    }
   }
 }
 
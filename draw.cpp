@@ -8,37 +8,167 @@
 #include "matrix.h"
 
 // duplicate top of stack
-void MyCanvas::save() {
+template <typename Device> void MyCanvasT<Device>::save() {
   GMatrix dup = ctm[ctm.size() - 1];
   ctm.push_back(dup);
+
+  DeviceClip clip = clips.back();
+  clips.push_back(clip);
 }
 
-// pop top of stack
-void MyCanvas::restore() {
+// save, then draw into a layer positioned at the device bounds of the (mapped) rect
+template <typename Device> void MyCanvasT<Device>::saveLayer(const GRect* bounds, const GPaint& paint) {
+  GMatrix mat = ctm[ctm.size() - 1];
+  GIRect layerBounds = clips.back().bounds;
+
+  if (bounds) {
+    GPoint pts[4] = {
+      { bounds->left, bounds->top }, { bounds->right, bounds->top },
+      { bounds->right, bounds->bottom }, { bounds->left, bounds->bottom }
+    };
+    mat.mapPoints(pts, pts, 4);
+
+    layerBounds = intersect(layerBounds, points_bounds(pts, 4).roundOut());
+  }
+
+  save();
+
+  // with no pixels (clipped away, or out of memory) the layer can't show anything: it stays a
+  // plain save with an empty clip, so its draws do nothing and restore has nothing to composite
+  Device layer = fLayerPool.acquire(layerBounds.width(), layerBounds.height());
+  if (!layer.pixels()) {
+    clips.back().bounds = GIRect::LTRB(0, 0, 0, 0);
+    return;
+  }
+
+  layers.push_back({ fDevice, layerBounds, paint, ctm.size() });
+  fDevice = layer;
+  init_layer(fDevice, layers.back().parent, layerBounds.left, layerBounds.top);
+
+  // from here on, draw in the layer's own coordinates
+  ctm.back() = GMatrix::Translate(-layerBounds.left, -layerBounds.top) * mat;
+
+  DeviceClip& clip = clips.back();
+  clip.bounds = GIRect::WH(layerBounds.width(), layerBounds.height());
+  if (clip.mask) {
+    clip.mask = std::make_shared<ClipMask>(*clip.mask, -layerBounds.left, -layerBounds.top);
+  }
+}
+
+// pop top of stack, compositing the layer if it was made by the matching saveLayer
+template <typename Device> void MyCanvasT<Device>::restore() {
+  bool endsLayer = layers.size() > 0 && layers.back().depth == ctm.size();
+
   ctm.erase(ctm.end() - 1);
+  clips.erase(clips.end() - 1);
+
+  if (endsLayer) {
+    Layer layer = layers.back();
+    layers.pop_back();
+
+    Device src = fDevice;
+    fDevice = layer.parent;
+
+    composite_layer(fDevice, clips.back(), src, layer.bounds.left, layer.bounds.top, layer.paint);
+    fLayerPool.release(src);
+
+    addDamage(layer.bounds);
+  }
+}
+
+// bounds are in the current device's space; drawing into a layer only damages the canvas once
+// the outermost layer is composited
+template <typename Device> void MyCanvasT<Device>::addDamage(const GIRect& bounds) {
+  if (layers.size() > 0) return;
+
+  fDamage = join(fDamage, intersect(bounds, clips.back().bounds));
 }
 
 // top of stack * matrix
-void MyCanvas::concat(const GMatrix& matrix) {
+template <typename Device> void MyCanvasT<Device>::concat(const GMatrix& matrix) {
   GMatrix& top = ctm.back();
   GMatrix res = GMatrix::Concat(top, matrix);
 
   top = res;
 }
 
-void MyCanvas::clear(const GColor& color) {
+// a rect under a scale/translate CTM stays a rect, and only needs to shrink the clip bounds
+template <typename Device> void MyCanvasT<Device>::clipRect(const GRect& rect) {
+  GMatrix mat = ctm[ctm.size() - 1];
+
+  if (mat[1] != 0.0f || mat[2] != 0.0f) {
+    GPath path;
+    path.addRect(rect);
+    clipPath(path);
+    return;
+  }
+
+  GPoint pts[2] = { { rect.left, rect.top }, { rect.right, rect.bottom } };
+  mat.mapPoints(pts, pts, 2);
+
+  GRect dev = GRect::LTRB(std::min(pts[0].x, pts[1].x), std::min(pts[0].y, pts[1].y),
+                          std::max(pts[0].x, pts[1].x), std::max(pts[0].y, pts[1].y));
+
+  DeviceClip& clip = clips.back();
+  clip.bounds = intersect(clip.bounds, dev.round());
+}
+
+// rasterize the path into a coverage mask, intersected with the current clip
+template <typename Device> void MyCanvasT<Device>::clipPath(const GPath& path) {
+  DeviceClip& clip = clips.back();
+  if (clip.isEmpty()) return;
+
+  std::vector<Segment> segments;
+  {
+    G_PROFILE_STAGE(kEdges_Stage);
+    GPath transform = path;
+    transform.transform(ctm[ctm.size() - 1]);
+    path_to_segments(clip.bounds, segments, transform);
+  }
+  G_PROFILE_EDGES(segments.size());
 
-  GPixel src = color_to_pixel(color);
+  auto mask = std::make_shared<ClipMask>(clip.bounds);
+  GIRect covered = GIRect::LTRB(clip.bounds.right, clip.bounds.bottom, clip.bounds.left, clip.bounds.top);
 
-  for (int y = 0; y < fDevice.height(); y++) {
-    GPixel* pixel = fDevice.getAddr(0, y);
-    for (int x = 0; x < fDevice.width(); x++) {
-      pixel[x] = src;
+  if (segments.size() >= 2 || path.isInverseFillType()) {
+    {
+      G_PROFILE_STAGE(kSort_Stage);
+      std::sort(segments.begin(), segments.end(), SegmentComparator());
     }
+
+    G_PROFILE_STAGE(kScan_Stage);
+    scan_path(fDevice, segments, path.getFillType(), [&](int y, const std::vector<Span> &spans) {
+      for (const Span& span : spans) {
+        clip.clipRow(y, span.left, span.right, [&](int l, int r) {
+          mask->fill(y, l, r);
+          covered = GIRect::LTRB(std::min(covered.left, l), std::min(covered.top, y),
+                                 std::max(covered.right, r), std::max(covered.bottom, y + 1));
+        });
+      }
+    });
+  }
+
+  clip.bounds = intersect(clip.bounds, covered);
+  clip.mask = mask;
+}
+
+template <typename Device> void MyCanvasT<Device>::clear(const GColor& color) {
+
+  Pixel src = color_to<Pixel>(color);
+  const DeviceClip& clip = clips.back();
+
+  addDamage(clip.bounds);
+
+  // kSrc, so each device stores the color in its own format
+  auto store = Traits::proc(GBlendMode::kSrc);
+  G_PROFILE_MODE(GBlendMode::kSrc);
+
+  for (int y = clip.bounds.top; y < clip.bounds.bottom; y++) {
+    blit_row(fDevice, clip, src, clip.bounds.left, y, clip.bounds.width(), store);
   }
 }
 
-void MyCanvas::drawRect(const GRect& rect, const GPaint& paint) {
+template <typename Device> void MyCanvasT<Device>::drawRect(const GRect& rect, const GPaint& paint) {
   // first get the transformed points
   GPoint p1 = { rect.left, rect.top };
   GPoint p2 = { rect.right, rect.top };
@@ -52,109 +182,138 @@ void MyCanvas::drawRect(const GRect& rect, const GPaint& paint) {
   drawConvexPolygon(pts, 4, paint);
 }
 
-void MyCanvas::drawConvexPolygon(const GPoint* pts, int count, const GPaint& paint) {
+template <typename Device> void MyCanvasT<Device>::drawConvexPolygon(const GPoint* pts, int count, const GPaint& paint) {
   // must have at least 3 points?
-  if (count < 3) return;
+  if (count < 3 || clips.back().isEmpty()) return;
 
   // retrieve top of stack
   GMatrix mat = ctm[ctm.size() - 1];
   GPoint dst[count];
-
-  // map points using top of stack
-  mat.mapPoints(dst, pts, count);
-  
   std::vector<Segment> segments;
+  {
+    G_PROFILE_STAGE(kEdges_Stage);
 
-  pts_to_segments(fDevice, segments, dst, count);
+    // map points using top of stack
+    mat.mapPoints(dst, pts, count);
+
+    pts_to_segments(clips.back().bounds, segments, dst, count);
+  }
+  G_PROFILE_EDGES(segments.size());
   if (segments.size() < 2) return;
   
-  std::sort(segments.begin(), segments.end());
+  {
+    G_PROFILE_STAGE(kSort_Stage);
+    std::sort(segments.begin(), segments.end());
+  }
+
+  addDamage(segments_bounds(segments));
 
-  BlendProc blendMode = gProcs[(int) paint.getBlendMode()];
+  GBlendMode mode = paint.getBlendMode();
 
   if (paint.getShader()) {
     GShader* sh = paint.getShader();
 
     if (sh->setContext(mat)) {
-      if (sh->isOpaque()) {
-        if (blendMode == srcOverMode) blendMode = srcMode;
-        if (blendMode == dstInMode) blendMode = dstMode;
-        if (blendMode == srcATopMode) blendMode = srcInMode;
-        if (blendMode == dstOutMode) blendMode = clearMode;
-        if (blendMode == xorMode) blendMode = srcOutMode;
-      }
+      mode = simplify_shader_blend_mode(sh, mode);
+      G_PROFILE_MODE(mode);
 
-      shade_fill_convex_polygon(fDevice, segments, sh, blendMode); 
+      G_PROFILE_STAGE(kScan_Stage);
+      shade_fill_convex_polygon(fDevice, clips.back(), segments, sh, Traits::proc(mode)); 
     }
 
   } else {
-    GPixel src = color_to_pixel(paint.getColor());
+    Pixel src = color_to<Pixel>(paint.getColor());
 
-    blendMode = simplify_blend_mode(paint, blendMode);
+    mode = simplify_blend_mode(paint, mode);
+    G_PROFILE_MODE(mode);
 
-    fill_convex_polygon(fDevice, segments, src, blendMode);
+    G_PROFILE_STAGE(kScan_Stage);
+    fill_convex_polygon(fDevice, clips.back(), segments, src, Traits::proc(mode));
   }
 }
 
-void MyCanvas::drawPath(const GPath& path, const GPaint& paint) {
+template <typename Device> void MyCanvasT<Device>::drawPolyline(const GPoint* pts, int count, const GPaint& paint) {
+  if (count < 2 || clips.back().isEmpty()) return;
+
   GMatrix mat = ctm[ctm.size() - 1];
-  GPath transform = path;
-  transform.transform(mat);
+  GPoint dst[count];
 
-  GPoint pts[4];
-  GPath::Edger iter(transform);
+  mat.mapPoints(dst, pts, count);
 
-  std::vector<Segment> segments;
+  GBlendMode mode = paint.getBlendMode();
+  GShader* sh = paint.getShader();
+
+  if (sh) {
+    if (!sh->setContext(mat)) return;
+    mode = simplify_shader_blend_mode(sh, mode);
+  } else {
+    mode = simplify_blend_mode(paint, mode);
+  }
 
-  // Handle quadratic and cubic curves in the path when clipping
-  // Draw curves with a tolerance of 1/4 pixel
+  Pixel src = color_to<Pixel>(paint.getColor());
+  auto blend = Traits::proc(mode);
 
-  while (auto v = iter.next(pts)) {
-    switch (v.value()) {
-      case GPath::kLine: // pts[0..1]
-        clip_segment(fDevice, segments, pts[0], pts[1]);
-        break;
+  // the pixel holding the last point can be plotted too
+  GIRect bounds = points_bounds(dst, count).roundOut();
+  addDamage(GIRect::LTRB(bounds.left, bounds.top, bounds.right + 1, bounds.bottom + 1));
 
-      case GPath::kQuad: // pts[0..2]
-        clip_quad_curve(fDevice, segments, pts[0], pts[1], pts[2]);
-        break;
+  for (int i = 0; i < count - 1; i++) {
+    GPoint a = dst[i];
+    GPoint b = dst[i + 1];
 
-      case GPath::kCubic: // pts[0..3]
-        clip_cubic_curve(fDevice, segments, pts[0], pts[1], pts[2], pts[3]);
-        break;
+    if (!clip_line(clips.back().bounds, a, b)) continue;
 
-      default:
-        break;
+    if (sh) {
+      shade_hairline(fDevice, clips.back(), a, b, sh, blend);
+    } else {
+      draw_hairline(fDevice, clips.back(), a, b, src, blend);
     }
   }
+}
 
-  if (segments.size() < 2) return;
+template <typename Device> void MyCanvasT<Device>::drawPath(const GPath& path, const GPaint& paint) {
+  if (clips.back().isEmpty()) return;
+
+  std::vector<Segment> segments;
+  {
+    G_PROFILE_STAGE(kEdges_Stage);
+    GPath transform = path;
+    transform.transform(ctm[ctm.size() - 1]);
+    path_to_segments(clips.back().bounds, segments, transform);
+  }
+  G_PROFILE_EDGES(segments.size());
+
+  // an inverse fill still covers the whole device when the path itself is empty
+  if (segments.size() < 2 && !path.isInverseFillType()) return;
   
-  std::sort(segments.begin(), segments.end(), SegmentComparator());
+  {
+    G_PROFILE_STAGE(kSort_Stage);
+    std::sort(segments.begin(), segments.end(), SegmentComparator());
+  }
+
+  addDamage(path.isInverseFillType() ? clips.back().bounds : segments_bounds(segments));
     
-  BlendProc blendMode = gProcs[(int) paint.getBlendMode()];
+  GBlendMode mode = paint.getBlendMode();
 
   if (paint.getShader()) {
     GShader* sh = paint.getShader();
 
     if (sh->setContext(ctm[ctm.size() - 1])) {
-      if (sh->isOpaque()) {
-        if (blendMode == srcOverMode) blendMode = srcMode;
-        if (blendMode == dstInMode) blendMode = dstMode;
-        if (blendMode == srcATopMode) blendMode = srcInMode;
-        if (blendMode == dstOutMode) blendMode = clearMode;
-        if (blendMode == xorMode) blendMode = srcOutMode;
-      }
+      mode = simplify_shader_blend_mode(sh, mode);
+      G_PROFILE_MODE(mode);
 
-      shade_fill_path(fDevice, segments, sh, blendMode);
+      G_PROFILE_STAGE(kScan_Stage);
+      shade_fill_path(fDevice, clips.back(), segments, sh, Traits::proc(mode), path.getFillType());
     }
 
   } else {  
-    GPixel src = color_to_pixel(paint.getColor());
+    Pixel src = color_to<Pixel>(paint.getColor());
 
-    blendMode = simplify_blend_mode(paint, blendMode);
+    mode = simplify_blend_mode(paint, mode);
+    G_PROFILE_MODE(mode);
 
-    fill_path(fDevice, segments, src, blendMode);
+    G_PROFILE_STAGE(kScan_Stage);
+    fill_path(fDevice, clips.back(), segments, src, Traits::proc(mode), path.getFillType());
   }
 }
 
@@ -165,7 +324,7 @@ void MyCanvas::drawPath(const GPath& path, const GPaint& paint) {
          *  together, component by component.
          */
 
-void MyCanvas::drawMesh(const GPoint verts[], const GColor colors[], const GPoint texs[],
+template <typename Device> void MyCanvasT<Device>::drawMesh(const GPoint verts[], const GColor colors[], const GPoint texs[],
               int count, const int indices[], const GPaint& paint) {
 
   GMatrix mat = ctm[ctm.size() - 1];
@@ -176,10 +335,7 @@ void MyCanvas::drawMesh(const GPoint verts[], const GColor colors[], const GPoin
   GColor c[3];
   GPoint t[3];
 
-  BlendProc blendMode = gProcs[(int) paint.getBlendMode()];
-
   int n = 0;
-  std::vector<Segment> segments;
 
   for (int i = 0; i < count; i++) {
     p[0] = verts[indices[n]];      
@@ -188,10 +344,6 @@ void MyCanvas::drawMesh(const GPoint verts[], const GColor colors[], const GPoin
 
     m = mat * GMatrix(p[1].x - p[0].x, p[2].x - p[0].x, p[0].x, p[1].y - p[0].y, p[2].y - p[0].y, p[0].y);
 
-    clip_segment(fDevice, segments, p[0], p[1]);
-    clip_segment(fDevice, segments, p[1], p[2]);
-    clip_segment(fDevice, segments, p[2], p[0]);
-
     if (colors) {        // triangle gradient
       c[0] = colors[indices[n]];     
       c[1] = colors[indices[n+1]];     
@@ -256,12 +408,12 @@ void MyCanvas::drawMesh(const GPoint verts[], const GColor colors[], const GPoin
          *
          *  colors and/or texs can be null. The resulting triangles should be passed to drawMesh(...).
          */
-void MyCanvas::drawQuad(const GPoint verts[4], const GColor colors[4], const GPoint texs[4],
+template <typename Device> void MyCanvasT<Device>::drawQuad(const GPoint verts[4], const GColor colors[4], const GPoint texs[4],
               int level, const GPaint& paint) {
 
   if (level == 0) {
     int indices[6] = {0, 1, 3, 1, 2, 3};
-    drawMesh(verts, colors, texs, 6, indices, paint);                                                                                                                                
+    drawMesh(verts, colors, texs, 2, indices, paint);
     return;
   }
 
@@ -359,7 +511,7 @@ void MyCanvas::drawQuad(const GPoint verts[4], const GColor colors[4], const GPo
          *
          *  colors and/or texs can be null. The resulting triangles should be passed to drawMesh(...).
          */
-void MyCanvas::drawCubicQuad(const GPoint verts[12], const GColor colors[4], const GPoint texs[4],
+template <typename Device> void MyCanvasT<Device>::drawCubicQuad(const GPoint verts[12], const GColor colors[4], const GPoint texs[4],
               int level, const GPaint& paint) {
 
   if (level == 0) {
@@ -438,10 +590,27 @@ void MyCanvas::drawCubicQuad(const GPoint verts[12], const GColor colors[4], con
 
 }
 
+template class MyCanvasT<GBitmap>;
+template class MyCanvasT<GBitmapF>;
+template class MyCanvasT<GBitmapA8>;
+template class MyCanvasT<GBitmap565>;
+
 std::unique_ptr<GCanvas> GCreateCanvas(const GBitmap& device) {
   return std::unique_ptr<GCanvas>(new MyCanvas(device));
 }
 
+std::unique_ptr<GCanvas> GCreateCanvasF(const GBitmapF& device) {
+  return std::unique_ptr<GCanvas>(new MyCanvasF(device));
+}
+
+std::unique_ptr<GCanvas> GCreateCanvasA8(const GBitmapA8& device) {
+  return std::unique_ptr<GCanvas>(new MyCanvasA8(device));
+}
+
+std::unique_ptr<GCanvas> GCreateCanvas565(const GBitmap565& device) {
+  return std::unique_ptr<GCanvas>(new MyCanvas565(device));
+}
+
 std::string GDrawSomething(GCanvas* canvas, GISize dim) {
   // GColor bg = GColor({ 1, 1, 1, 1 });
   // canvas->clear(bg);
@@ -66,11 +66,41 @@ public:
      */
     bool readFromFile(const char path[]);
 
+    enum PNGLevel {
+        kFast_PNGLevel,     // try fewer filters and search less for matches: bigger, but faster
+        kDefault_PNGLevel,
+    };
+
     /*
      *  Attempt to write the bitmap as a PNG into a new file (the file will be created/overwritten).
      *  Return true on success.
+     *
+     *  threads is the most chunks of rows to encode at once (see GPNGWriter): 0 means one per
+     *  hardware thread. Callers that already write several files at once should leave it at 1.
+     */
+    bool writeToFile(const char path[], PNGLevel = kDefault_PNGLevel, int threads = 1) const;
+
+    /*
+     *  Write the pixels uncompressed (premultiplied, each row padded to a multiple of 64 bytes)
+     *  after a small header that also records isOpaque(), for mapFromFile(). The file is only
+     *  meant to be read on a machine of the same byte order. Return true on success.
+     */
+    bool writeToRawFile(const char path[]) const;
+
+    /**
+     *  Map a file written by writeToRawFile() into memory, and set the bitmap to its pixels:
+     *  nothing is decoded or copied, and opaqueness comes from the header. Pages are copy-on-write,
+     *  so drawing into the bitmap never changes the file.
+     *
+     *  On success the caller must call unmapFile() (not free()) when they are finished.
+     *  On failure, return false and bitmap is reset to empty.
+     */
+    bool mapFromFile(const char path[]);
+
+    /**
+     *  Release the mapping made by mapFromFile(), and reset to empty.
      */
-    bool writeToFile(const char path[]) const;
+    void unmapFile();
 
     /**
      *  Allocate the memory for the bitmap. If rowBytes is 0, it will be computed from w.
@@ -10,6 +10,9 @@
 #include <string>
 
 class GBitmap;
+class GBitmapF;
+class GBitmapA8;
+class GBitmap565;
 class GPath;
 class GPoint;
 class GRect;
@@ -19,7 +22,7 @@ public:
     virtual ~GCanvas() {}
 
     /**
-     *  Save off a copy of the canvas state (CTM), to be later used if the balancing call to
+     *  Save off a copy of the canvas state (CTM and clip), to be later used if the balancing call to
      *  restore() is made. Calls to save/restore can be nested:
      *  save();
      *      save();
@@ -32,7 +35,14 @@ public:
     virtual void save() = 0;
 
     /**
-     *  Copy the canvas state (CTM) that was record in the correspnding call to save() back into
+     *  Like save(), but also redirects drawing into a new transparent offscreen layer that covers
+     *  bounds (mapped by the CTM), or the whole clip if bounds is null. The balancing restore()
+     *  blends the layer back into the canvas using the paint's alpha and blendmode.
+     */
+    virtual void saveLayer(const GRect* bounds, const GPaint&) = 0;
+
+    /**
+     *  Copy the canvas state (CTM and clip) that was record in the correspnding call to save() back into
      *  the canvas. It is an error to call restore() if there has been no previous call to save().
      */
     virtual void restore() = 0;
@@ -46,7 +56,30 @@ public:
     virtual void concat(const GMatrix& matrix) = 0;
 
     /**
-     *  Fill the entire canvas with the specified color, using kSrc porter-duff mode.
+     *  Intersect the clip with the rectangle, mapped by the CTM. Subsequent drawing (including
+     *  clear) only affects pixels whose centers are inside the clip. The canvas is constructed
+     *  with the clip set to the bounds of its bitmap.
+     */
+    virtual void clipRect(const GRect&) = 0;
+
+    /**
+     *  Intersect the clip with the path (honoring its fill type), mapped by the CTM.
+     */
+    virtual void clipPath(const GPath&) = 0;
+
+    /**
+     *  Return the device-space bounds of every pixel the canvas may have changed since it was
+     *  created or resetDamage() was last called. Empty if nothing was drawn.
+     */
+    virtual GIRect getDamage() const = 0;
+
+    /**
+     *  Forget the damage accumulated so far, e.g. once it has been presented.
+     */
+    virtual void resetDamage() = 0;
+
+    /**
+     *  Fill the entire canvas (within the clip) with the specified color, using kSrc porter-duff mode.
      */
     virtual void clear(const GColor&) = 0;
 
@@ -65,7 +98,17 @@ public:
     virtual void drawConvexPolygon(const GPoint[], int count, const GPaint&) = 0;
 
     /**
-     *  Fill the path with the paint, interpreting the path using winding-fill (non-zero winding).
+     *  Draw a connected series of hairlines (lines exactly 1 pixel wide, independent of the CTM)
+     *  through pts[0..count-1], using the paint's color or shader and blendmode.
+     *
+     *  Each segment covers the pixels whose centers it passes over along its major axis,
+     *  excluding its last pixel, so consecutive segments do not blend their shared pixel twice.
+     */
+    virtual void drawPolyline(const GPoint[], int count, const GPaint&) = 0;
+
+    /**
+     *  Fill the path with the paint, interpreting the path using its fill type
+     *  (non-zero winding by default, see GPath::FillType).
      */
     virtual void drawPath(const GPath&, const GPaint&) = 0;
 
@@ -144,6 +187,11 @@ public:
     void fillRect(const GRect& rect, const GColor& color) {
         this->drawRect(rect, GPaint(color));
     }
+
+    void drawLine(GPoint p0, GPoint p1, const GPaint& paint) {
+        const GPoint pts[2] = { p0, p1 };
+        this->drawPolyline(pts, 2, paint);
+    }
 };
 
 /**
@@ -152,6 +200,20 @@ public:
  */
 std::unique_ptr<GCanvas> GCreateCanvas(const GBitmap& bitmap);
 
+/**
+ *  Same as GCreateCanvas, but for a float device: pixels are blended in float, so stacking
+ *  many translucent draws does not accumulate 8-bit rounding (banding).
+ */
+std::unique_ptr<GCanvas> GCreateCanvasF(const GBitmapF& bitmap);
+
+/**
+ *  Same as GCreateCanvas, but for compact devices: an A8 canvas computes only coverage (alpha),
+ *  and a 565 canvas stores opaque 16-bit color. Both write their format directly, rather than
+ *  rendering 32-bit and converting afterwards.
+ */
+std::unique_ptr<GCanvas> GCreateCanvasA8(const GBitmapA8& bitmap);
+std::unique_ptr<GCanvas> GCreateCanvas565(const GBitmap565& bitmap);
+
 /**
  *  Implement this, drawing into the provided canvas, and returning the title of your artwork.
  */
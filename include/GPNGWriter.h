@@ -0,0 +1,61 @@
+#ifndef GPNGWriter_DEFINED
+#define GPNGWriter_DEFINED
+
+#include "GBitmap.h"
+#include <stdio.h>
+#include <vector>
+
+/**
+ *  Writes a PNG a few rows at a time, so the whole image never has to be in memory: each call
+ *  to writeRows() filters and deflates its rows and appends them to the file as an IDAT chunk.
+ *  Memory use is proportional to the width and to the rows passed per call.
+ *
+ *  The rows of each call can be split into chunks that are encoded on separate threads.
+ *
+ *  Usage: begin(), then writeRows() until height rows were written, then end().
+ */
+class GPNGWriter {
+public:
+    GPNGWriter();
+    ~GPNGWriter();
+
+    /**
+     *  Create (or overwrite) the file and write the PNG header for an RGBA image of the given
+     *  size. Returns false if the file could not be opened.
+     *
+     *  threads is the most chunks to encode at once; 0 means one per hardware thread. The
+     *  threads are started by each writeRows(), so when it is called for a few rows at a time
+     *  (or from code that is already parallel) one thread is usually faster.
+     */
+    bool begin(const char path[], int width, int height,
+               GBitmap::PNGLevel = GBitmap::kDefault_PNGLevel, int threads = 1);
+
+    /**
+     *  Append the first [count] rows of bm, whose width must match the image. Returns false
+     *  on a write error, or if this would exceed the height passed to begin().
+     */
+    bool writeRows(const GBitmap& bm, int count);
+
+    /**
+     *  Finish the stream and close the file. Returns false if fewer rows than the height were
+     *  written, or on a write error.
+     */
+    bool end();
+
+private:
+    FILE*    fFile;
+    int      fWidth;
+    int      fHeight;
+    int      fRowsWritten;
+    GBitmap::PNGLevel fLevel;
+    int      fThreads;
+
+    std::vector<uint8_t> fPrevRow;      // the last row, unfiltered, for the Up/Average/Paeth filters
+    std::vector<uint8_t> fChunk;        // "IDAT" + compressed bytes
+    uint32_t fAdler;                    // of all the (filtered) bytes so far
+
+    bool flushChunk();
+    void close();
+};
+
+#endif
@@ -87,6 +87,49 @@ public:
 
     int countPoints() const { return (int)fPts.size(); }
 
+    enum CapType {
+        kButt_CapType,      // ends exactly at the endpoints
+        kRound_CapType,     // half circle of radius width/2 beyond the endpoints
+        kSquare_CapType,    // half square of size width/2 beyond the endpoints
+    };
+
+    enum JoinType {
+        kMiter_JoinType,    // sharp corner, falling back to bevel past the miter limit
+        kRound_JoinType,
+        kBevel_JoinType,
+    };
+
+    /**
+     *  Return a new path which, filled with the winding rule, covers the outline of this path
+     *  stroked with the specified width. Curves are offset with quadratic approximations.
+     *
+     *  A contour whose last point equals its first point is stroked as closed (joined all the
+     *  way around); every other contour is open and gets caps at both ends.
+     *
+     *  miterLimit is the longest allowed ratio of miter length to stroke width. If width <= 0
+     *  the returned path is empty.
+     */
+    GPath stroke(float width, CapType = kButt_CapType, JoinType = kMiter_JoinType,
+                 float miterLimit = 4) const;
+
+    /**
+     *  How the interior of the path is determined when it is filled. The inverse variants
+     *  fill everything that the corresponding non-inverse type would leave untouched.
+     */
+    enum FillType {
+        kWinding_FillType,          // non-zero winding (the default)
+        kEvenOdd_FillType,          // odd number of crossings
+        kInverseWinding_FillType,
+        kInverseEvenOdd_FillType,
+    };
+
+    FillType getFillType() const { return fFillType; }
+    void setFillType(FillType ft) { fFillType = ft; }
+
+    bool isInverseFillType() const {
+        return fFillType == kInverseWinding_FillType || fFillType == kInverseEvenOdd_FillType;
+    }
+
     /**
      *  Return the tight bounds of all of the curve and line segments in the path.
      *  Curve segments may need to be chopped at X and Y extrema to compute this correctly.
@@ -181,6 +224,7 @@ public:
 private:
     std::vector<GPoint> fPts;
     std::vector<Verb>   fVbs;
+    FillType            fFillType = kWinding_FillType;
 };
 
 #endif
@@ -0,0 +1,62 @@
+#ifndef GPicture_DEFINED
+#define GPicture_DEFINED
+
+#include "GCanvas.h"
+#include <memory>
+
+/**
+ *  A recorded list of canvas calls (a display list), that can be replayed into any canvas.
+ *
+ *  Paints are recorded by value, so any shader they reference must outlive the picture.
+ */
+class GPicture {
+public:
+    virtual ~GPicture() {}
+
+    // Number of calls that were recorded.
+    virtual int countOps() const = 0;
+
+    // Number of recorded draws that playback() skips, because they are entirely hidden.
+    virtual int countCulled() const = 0;
+
+    /**
+     *  Replay the recorded calls into the canvas, on top of its current CTM and clip.
+     *
+     *  Draws are visited front-to-back first, tracking the rects that later opaque draws fully
+     *  overwrite (opaque srcOver paints, src/clear modes, and clear()). A draw that lies entirely
+     *  behind them is skipped, and one that is only partly hidden is clipped to what remains.
+     */
+    virtual void playback(GCanvas*) const = 0;
+
+    /**
+     *  Replay every recorded call as it was made, culling nothing (what playback() does in
+     *  reference mode).
+     */
+    virtual void playbackAll(GCanvas*) const = 0;
+};
+
+/**
+ *  Records the calls made to the returned canvas, whose device is width x height, until
+ *  finishRecording() is called.
+ */
+class GPictureRecorder {
+public:
+    GPictureRecorder();
+    ~GPictureRecorder();
+
+    GCanvas* beginRecording(int width, int height);
+    std::unique_ptr<GPicture> finishRecording();
+
+private:
+    std::unique_ptr<GCanvas> fRecorder;
+};
+
+/**
+ *  Render the picture into a width x height PNG file, stripHeight rows at a time: each strip is
+ *  played back into the same strip-sized bitmap (with the CTM shifted up by the strip's top)
+ *  and streamed to the file, so memory is proportional to width * stripHeight rather than to
+ *  the whole image. Returns false if the file could not be written.
+ */
+bool GWritePictureStrips(const GPicture&, int width, int height, int stripHeight, const char path[]);
+
+#endif
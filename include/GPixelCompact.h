@@ -0,0 +1,132 @@
+#ifndef GPixelCompact_DEFINED
+#define GPixelCompact_DEFINED
+
+#include "GBitmap.h"
+#include <stdlib.h>
+
+/**
+ *  Coverage only: the alpha of a GPixel, e.g. for masks.
+ */
+typedef uint8_t GPixelA8;
+
+/**
+ *  An opaque color packed as 5 bits of red (high), 6 of green and 5 of blue (low), as used by
+ *  many embedded displays.
+ */
+typedef uint16_t GPixel565;
+
+static inline GPixel565 GPixel565_Pack(unsigned r, unsigned g, unsigned b) {
+    assert(r <= 31 && g <= 63 && b <= 31);
+    return (GPixel565)((r << 11) | (g << 5) | b);
+}
+
+static inline unsigned GPixel565_GetR(GPixel565 p) { return p >> 11; }
+static inline unsigned GPixel565_GetG(GPixel565 p) { return (p >> 5) & 63; }
+static inline unsigned GPixel565_GetB(GPixel565 p) { return p & 31; }
+
+// Rounds 8-bit colors to 5 or 6 bits.
+static inline GPixel565 GPixel565_FromRGB(unsigned r, unsigned g, unsigned b) {
+    auto to5 = [](unsigned c) { return (c * 31 + 128) / 255; };
+    auto to6 = [](unsigned c) { return (c * 63 + 128) / 255; };
+    return GPixel565_Pack(to5(r), to6(g), to5(b));
+}
+
+/**
+ *  The alpha is dropped, so a translucent pixel lands as if it had been drawn over black.
+ */
+static inline GPixel565 GPixel565_FromPixel(GPixel p) {
+    return GPixel565_FromRGB(GPixel_GetR(p), GPixel_GetG(p), GPixel_GetB(p));
+}
+
+// Widens by replicating the high bits, so 0 and the max map to 0 and 255.
+static inline GPixel GPixel565_ToPixel(GPixel565 p) {
+    unsigned r = GPixel565_GetR(p), g = GPixel565_GetG(p), b = GPixel565_GetB(p);
+    return GPixel_PackARGB(255, (r << 3) | (r >> 2), (g << 2) | (g >> 4), (b << 3) | (b >> 2));
+}
+
+static inline GPixel GPixelA8_ToPixel(GPixelA8 a) {
+    return GPixel_PackARGB(a, 0, 0, 0);
+}
+
+/**
+ *  A bitmap of compact pixels (GPixelA8 or GPixel565). See GBitmapA8 and GBitmap565.
+ */
+template <typename Pixel> class GCompactBitmap {
+public:
+    GCompactBitmap() { this->reset(); }
+
+    int width() const { return fWidth; }
+    int height() const { return fHeight; }
+    size_t rowBytes() const { return fRowBytes; }
+    Pixel* pixels() const { return fPixels; }
+
+    void reset() {
+        fWidth = 0;
+        fHeight = 0;
+        fPixels = nullptr;
+        fRowBytes = 0;
+    }
+
+    void reset(int w, int h, size_t rb, Pixel* pixels) {
+        assert(w >= 0 && h >= 0);
+        assert((size_t)w * sizeof(Pixel) <= rb);
+
+        fWidth = w;
+        fHeight = h;
+        fRowBytes = rb;
+        fPixels = pixels;
+    }
+
+    Pixel* getAddr(int x, int y) const {
+        assert(x >= 0 && x < this->width());
+        assert(y >= 0 && y < this->height());
+        return (Pixel*)((char*)fPixels + y * fRowBytes) + x;
+    }
+
+    /**
+     *  Allocate zeroed memory for the bitmap with calloc(). The caller must call
+     *  free(pixels()) when they are finished.
+     */
+    void alloc(int w, int h) {
+        size_t rb = w * sizeof(Pixel);
+        this->reset(w, h, rb, (Pixel*)calloc(h, rb));
+    }
+
+    /**
+     *  Write the pixels, widened to 32 bits, into dst, which must be at least as large.
+     */
+    void readPixels(const GBitmap& dst) const {
+        assert(dst.width() >= fWidth && dst.height() >= fHeight);
+
+        for (int y = 0; y < fHeight; ++y) {
+            const Pixel* src = this->getAddr(0, y);
+            GPixel* row = dst.getAddr(0, y);
+            for (int x = 0; x < fWidth; ++x) {
+                row[x] = ToPixel(src[x]);
+            }
+        }
+    }
+
+private:
+    int      fWidth;
+    int      fHeight;
+    Pixel*   fPixels;
+    size_t   fRowBytes;
+
+    static GPixel ToPixel(GPixelA8 p) { return GPixelA8_ToPixel(p); }
+    static GPixel ToPixel(GPixel565 p) { return GPixel565_ToPixel(p); }
+};
+
+/**
+ *  An alpha-only bitmap. Drawing into it (see GCreateCanvasA8) computes only the alpha that a
+ *  GBitmap would have received.
+ */
+class GBitmapA8 : public GCompactBitmap<GPixelA8> {};
+
+/**
+ *  An opaque 16-bit bitmap (see GCreateCanvas565). Sources still blend with their alpha, but
+ *  the result is always opaque.
+ */
+class GBitmap565 : public GCompactBitmap<GPixel565> {};
+
+#endif
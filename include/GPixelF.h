@@ -0,0 +1,98 @@
+#ifndef GPixelF_DEFINED
+#define GPixelF_DEFINED
+
+#include "GBitmap.h"
+#include "GMath.h"
+#include <stdlib.h>
+
+/**
+ *  A premultiplied pixel with a float per component. Unlike GPixel, values are not quantized
+ *  after each blend, and may exceed 1 (e.g. for HDR content).
+ */
+struct GPixelF {
+    float r, g, b, a;
+};
+
+static inline GPixelF GPixelF_FromPixel(GPixel p) {
+    const float scale = 1 / 255.0f;
+    return { GPixel_GetR(p) * scale, GPixel_GetG(p) * scale,
+             GPixel_GetB(p) * scale, GPixel_GetA(p) * scale };
+}
+
+/**
+ *  Rounds to 8 bits, clamping alpha to [0, 1] and the colors to [0, alpha].
+ */
+static inline GPixel GPixelF_ToPixel(const GPixelF& p) {
+    float a = std::max(0.0f, std::min(1.0f, p.a));
+    auto pin = [a](float c) { return GRoundToInt(std::max(0.0f, std::min(a, c)) * 255); };
+
+    return GPixel_PackARGB(GRoundToInt(a * 255), pin(p.r), pin(p.g), pin(p.b));
+}
+
+/**
+ *  A bitmap of GPixelF, for canvases that render in float (see GCreateCanvasF).
+ */
+class GBitmapF {
+public:
+    GBitmapF() { this->reset(); }
+
+    int width() const { return fWidth; }
+    int height() const { return fHeight; }
+    size_t rowBytes() const { return fRowBytes; }
+    GPixelF* pixels() const { return fPixels; }
+
+    void reset() {
+        fWidth = 0;
+        fHeight = 0;
+        fPixels = nullptr;
+        fRowBytes = 0;
+    }
+
+    void reset(int w, int h, size_t rb, GPixelF* pixels) {
+        assert(w >= 0 && h >= 0);
+        assert((size_t)w * sizeof(GPixelF) <= rb);
+
+        fWidth = w;
+        fHeight = h;
+        fRowBytes = rb;
+        fPixels = pixels;
+    }
+
+    GPixelF* getAddr(int x, int y) const {
+        assert(x >= 0 && x < this->width());
+        assert(y >= 0 && y < this->height());
+        return (GPixelF*)((char*)fPixels + y * fRowBytes) + x;
+    }
+
+    /**
+     *  Allocate zeroed (transparent) memory for the bitmap with calloc(). The caller must call
+     *  free(pixels()) when they are finished.
+     */
+    void alloc(int w, int h) {
+        size_t rb = w * sizeof(GPixelF);
+        this->reset(w, h, rb, (GPixelF*)calloc(h, rb));
+    }
+
+    /**
+     *  Write the pixels, rounded to 8 bits, into dst, which must be at least as large.
+     */
+    void readPixels(const GBitmap& dst) const {
+        assert(dst.width() >= fWidth && dst.height() >= fHeight);
+
+        for (int y = 0; y < fHeight; ++y) {
+            const GPixelF* src = this->getAddr(0, y);
+            GPixel* row = dst.getAddr(0, y);
+            for (int x = 0; x < fWidth; ++x) {
+                row[x] = GPixelF_ToPixel(src[x]);
+            }
+        }
+    }
+
+private:
+    int      fWidth;
+    int      fHeight;
+    GPixelF* fPixels;
+    size_t   fRowBytes;
+};
+
+#endif
@@ -0,0 +1,74 @@
+#ifndef GProfile_DEFINED
+#define GProfile_DEFINED
+
+#include "GBlendMode.h"
+#include <stdio.h>
+
+class GShader;
+
+/**
+ *  Counters and stage timers for the rasterizer, e.g. to tell whether a bench is bound by
+ *  building edges, sorting them, or blending.
+ *
+ *  They are compiled out unless the library is built with -DG_PROFILE (see "make pbench"):
+ *  otherwise the G_PROFILE_* macros expand to nothing and every counter stays 0. When compiled
+ *  in, each span pays for a few atomic adds, a lookup in a per-thread table of shader classes
+ *  and two clock reads (but takes no lock), so absolute timings are inflated; compare the
+ *  stages against each other, not against an unprofiled build.
+ */
+class GProfile {
+public:
+    enum Stage {
+        kEdges_Stage,   // transforming, clipping and building segments (incl. curves)
+        kSort_Stage,    // sorting the segments
+        kScan_Stage,    // walking the segments into spans, excluding shade and blend
+        kShade_Stage,   // shader rows
+        kBlend_Stage,   // blending rows into the device
+    };
+    static constexpr int kStageCount = kBlend_Stage + 1;
+
+    static bool Enabled();
+
+    static void Reset();
+
+    /**
+     *  Print every non-zero counter, each divided by [draws] (e.g. the number of bench draws
+     *  they were collected over).
+     */
+    static void Dump(FILE*, double draws = 1);
+
+    static void AddEdges(int count);
+    // A span of [pixels] blended with the mode of the current draw (see SetMode)
+    static void AddSpan(int pixels);
+    static void AddShaded(const GShader*, int pixels);
+    static void SetMode(GBlendMode);
+
+    /**
+     *  Charges the time until it is destroyed to its stage. Timers nest, and a stage is charged
+     *  only for its own time: a blend inside a scan is not counted as scan time.
+     */
+    class Timer {
+    public:
+        Timer(Stage);
+        ~Timer();
+
+    private:
+        int fPrev;
+    };
+};
+
+#ifdef G_PROFILE
+    #define G_PROFILE_STAGE(stage)      GProfile::Timer G_PROFILE_timer_##stage(GProfile::stage)
+    #define G_PROFILE_EDGES(count)      GProfile::AddEdges(count)
+    #define G_PROFILE_SPAN(pixels)      GProfile::AddSpan(pixels)
+    #define G_PROFILE_SHADED(sh, n)     GProfile::AddShaded(sh, n)
+    #define G_PROFILE_MODE(mode)        GProfile::SetMode(mode)
+#else
+    #define G_PROFILE_STAGE(stage)
+    #define G_PROFILE_EDGES(count)      do {} while (0)
+    #define G_PROFILE_SPAN(pixels)      do {} while (0)
+    #define G_PROFILE_SHADED(sh, n)     do {} while (0)
+    #define G_PROFILE_MODE(mode)        do {} while (0)
+#endif
+
+#endif
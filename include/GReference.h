@@ -0,0 +1,22 @@
+#ifndef GReference_DEFINED
+#define GReference_DEFINED
+
+// Per thread, so a reference render can run next to normal ones. Inline (not behind a call),
+// since the blitters check it for every row they blend.
+inline thread_local bool gReferenceMode = false;
+
+/**
+ *  Reference mode, for checking the rasterizer's fast paths against its plain ones. While it is
+ *  on (for the calling thread), drawing:
+ *   - blends every pixel through the per-pixel procs of the blend modes, instead of the
+ *     specialized row loops;
+ *   - keeps the paint's blend mode, instead of simplifying it for opaque or clear sources;
+ *   - takes the general loops in the bitmap shader;
+ *   - plays pictures back without culling hidden draws.
+ *
+ *  The results should match a normal render (see image --reference); it is only slower.
+ */
+inline void GSetReferenceMode(bool enabled) { gReferenceMode = enabled; }
+inline bool GGetReferenceMode() { return gReferenceMode; }
+
+#endif
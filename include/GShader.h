@@ -6,12 +6,15 @@
 #define GShader_DEFINED
 
 #include <memory>
+#include <vector>
 #include "GColor.h"
+#include "GMatrix.h"
 #include "GPixel.h"
+#include "GPixelF.h"
+#include "GPixelCompact.h"
 #include "GPoint.h"
 
 class GBitmap;
-class GMatrix;
 
 enum class GTileMode {
     kClamp,
@@ -19,6 +22,25 @@ enum class GTileMode {
     kMirror,
 };
 
+/**
+ *  The arguments a shader was created with (see GShader::describe), so that a trace can
+ *  record it and make it again.
+ */
+struct GShaderDesc {
+    enum Type {
+        kBitmap,            // GCreateBitmapShader
+        kLinearGradient,    // GCreateLinearGradient
+    };
+
+    Type                type = kBitmap;
+    GTileMode           tileMode = GTileMode::kClamp;
+    const GBitmap*      bitmap = nullptr;   // kBitmap: the shader's own, not a copy
+    GMatrix             localMatrix;        // kBitmap
+    GPoint              p0 = {0, 0};        // kLinearGradient
+    GPoint              p1 = {0, 0};
+    std::vector<GColor> colors;
+};
+
 /**
  *  GShaders create colors to fill whatever geometry is being drawn to a GCanvas.
  */
@@ -38,6 +60,55 @@ public:
      *  can hold at least [count] entries.
      */
     virtual void shadeRow(int x, int y, int count, GPixel row[]) = 0;
+
+    /**
+     *  Fill out the arguments this shader was created with, for tracing (see GTrace.h).
+     *  Shaders that can't be recreated from them (e.g. ones wrapping other shaders) return false.
+     */
+    virtual bool describe(GShaderDesc*) const { return false; }
+
+    /**
+     *  Same as shadeRow(), but returning float pixels, for canvases that render in float.
+     *  By default this widens the output of shadeRow(); shaders that compute their colors in
+     *  float should override it to skip the 8-bit step.
+     */
+    virtual void shadeRowF(int x, int y, int count, GPixelF row[]) {
+        GPixel tmp[64];
+        while (count > 0) {
+            int n = std::min(count, 64);
+            this->shadeRow(x, y, n, tmp);
+            for (int i = 0; i < n; ++i) {
+                row[i] = GPixelF_FromPixel(tmp[i]);
+            }
+            x += n;
+            row += n;
+            count -= n;
+        }
+    }
+
+    /**
+     *  Same as shadeRow(), but returning only the alpha, for alpha-only (A8) canvases.
+     *  By default an opaque shader returns 255 without shading, and any other extracts the
+     *  alpha from shadeRow().
+     */
+    virtual void shadeRowA8(int x, int y, int count, GPixelA8 row[]) {
+        if (this->isOpaque()) {
+            std::fill(row, row + count, 0xFF);
+            return;
+        }
+
+        GPixel tmp[64];
+        while (count > 0) {
+            int n = std::min(count, 64);
+            this->shadeRow(x, y, n, tmp);
+            for (int i = 0; i < n; ++i) {
+                row[i] = GPixel_GetA(tmp[i]);
+            }
+            x += n;
+            row += n;
+            count -= n;
+        }
+    }
 };
 
 /**
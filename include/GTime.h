@@ -8,10 +8,14 @@
 #include "GTypes.h"
 
 using GMSec = unsigned long;
+using GNSec = uint64_t;
 
 class GTime {
 public:
     static GMSec GetMSec();
+
+    // Monotonic nanoseconds since an arbitrary start, for timing short intervals.
+    static GNSec GetNSec();
 };
 
 #endif
@@ -0,0 +1,46 @@
+#ifndef GTrace_DEFINED
+#define GTrace_DEFINED
+
+#include "GCanvas.h"
+#include <memory>
+
+/**
+ *  A recorded stream of canvas calls, with everything they reference (paths, meshes, shaders
+ *  and the shaders' bitmaps), loaded from a file written by a trace canvas.
+ *
+ *  Unlike a GPicture, a trace outlives the code that made it: record one from a real workload,
+ *  then replay it elsewhere (e.g. bench --trace) or attach it to a bug report.
+ */
+class GTrace {
+public:
+    virtual ~GTrace() {}
+
+    // The device size the calls were recorded for.
+    virtual GISize size() const = 0;
+
+    // Number of calls that were recorded.
+    virtual int countCalls() const = 0;
+
+    // Replay every call, as it was made, into the canvas.
+    virtual void playback(GCanvas*) const = 0;
+};
+
+/**
+ *  Returns a canvas that appends each call made to it to a trace file at path, and forwards it
+ *  to target (if not null), so a live canvas can be traced as it draws. The file is complete
+ *  when the canvas is destroyed. Returns null if the file can not be created.
+ *
+ *  Each bitmap is written the first time a shader draws it, and referred to after that, so its
+ *  pixels must not change while it is being traced. A shader that can't describe itself (see
+ *  GShader::describe) is recorded as no shader.
+ */
+std::unique_ptr<GCanvas> GCreateTraceCanvas(const char path[], GISize size,
+                                            GCanvas* target = nullptr);
+
+/**
+ *  Read a trace written by a trace canvas. Returns null if the file can not be read, or is not
+ *  a well-formed trace.
+ */
+std::unique_ptr<GTrace> GLoadTrace(const char path[]);
+
+#endif
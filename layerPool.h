@@ -0,0 +1,97 @@
+#ifndef _g_layer_pool_h_
+#define _g_layer_pool_h_
+
+#include "include/GBitmap.h"
+#include "include/GPixelF.h"
+#include "include/GPixelCompact.h"
+#include <vector>
+
+// Recycles the pixel memory of offscreen layers. Buffers are bucketed by size class (a power of
+// two times 1, 1.25, 1.5 or 1.75, so at most a quarter is wasted), and a layer can reuse any
+// released buffer from its bucket regardless of its exact dimensions.
+// Device is GBitmap, GBitmapF, GBitmapA8 or GBitmap565.
+template <typename Device> class LayerPool {
+  public:
+    LayerPool() {}
+    LayerPool(const LayerPool&) = delete;
+    LayerPool& operator=(const LayerPool&) = delete;
+
+    ~LayerPool() {
+      for (auto& bucket : fFree) {
+        for (void* pixels : bucket) free(pixels);
+      }
+    }
+
+    // returns a cleared (transparent) bitmap of the given size, or an empty one if there is no
+    // memory for it
+    Device acquire(int w, int h) {
+      Device bm;
+      if (w <= 0 || h <= 0) return bm;
+
+      size_t rb = w * sizeof(*bm.pixels());
+      int index = bucket(h * rb);
+
+      void* pixels;
+      if (fFree[index].size() > 0) {
+        pixels = fFree[index].back();
+        fFree[index].pop_back();
+      } else {
+        pixels = malloc(class_size(index));
+        if (!pixels) return bm;
+      }
+
+      memset(pixels, 0, h * rb);
+      wrap(bm, w, h, rb, pixels);
+      return bm;
+    }
+
+    void release(const Device& bm) {
+      if (!bm.pixels()) return;
+
+      int index = bucket(bm.height() * bm.rowBytes());
+
+      if (fFree[index].size() < kMaxPerBucket) {
+        fFree[index].push_back(bm.pixels());
+      } else {
+        free(bm.pixels());
+      }
+    }
+
+  private:
+    static constexpr int kBucketCount = 4 * 48;
+    static constexpr size_t kMaxPerBucket = 4;
+
+    std::vector<void*> fFree[kBucketCount];
+
+    static void wrap(GBitmap& bm, int w, int h, size_t rb, void* pixels) {
+      bm.reset(w, h, rb, (GPixel*) pixels, GBitmap::kNo_IsOpaque);
+    }
+
+    static void wrap(GBitmapF& bm, int w, int h, size_t rb, void* pixels) {
+      bm.reset(w, h, rb, (GPixelF*) pixels);
+    }
+
+    static void wrap(GBitmapA8& bm, int w, int h, size_t rb, void* pixels) {
+      bm.reset(w, h, rb, (GPixelA8*) pixels);
+    }
+
+    static void wrap(GBitmap565& bm, int w, int h, size_t rb, void* pixels) {
+      bm.reset(w, h, rb, (GPixel565*) pixels);
+    }
+
+    // bytes in the buffers of a bucket: 2^(index / 4) times 1, 1.25, 1.5 or 1.75
+    static size_t class_size(int index) {
+      return ((size_t) (4 + (index & 3)) << (index >> 2)) >> 2;
+    }
+
+    // smallest size class that holds the bytes
+    static int bucket(size_t bytes) {
+      int index = 0;
+      while (class_size(index) < bytes) index++;
+
+      assert(index < kBucketCount);
+      return index;
+    }
+};
+
+#endif
@@ -208,4 +208,295 @@ void GPath::ChopCubicAt(const GPoint src[4], GPoint dst[7], float t) {
   dst[4] = g * t + f * (1-t);
   dst[5] = g;
   dst[6] = src[3];
-}
\ No newline at end of file
+}
+
+// STROKING
+
+GPoint stroke_normal(GVector d, float radius) {
+  float len = d.length();
+  if (len == 0.0f) return { 0, 0 };
+
+  return { -d.y * radius / len, d.x * radius / len };
+}
+
+float cross(GVector a, GVector b) {
+  return a.x * b.y - a.y * b.x;
+}
+
+float dot(GVector a, GVector b) {
+  return a.x * b.x + a.y * b.y;
+}
+
+// twice the signed area of the polygon; positive for the same orientation as kCW_Direction
+float signed_area(const GPoint pts[], int count) {
+  float area = 0.0f;
+
+  for (int i = 0; i < count; i++) {
+    int j = (i + 1) % count;
+    area += cross(pts[i], pts[j]);
+  }
+
+  return area;
+}
+
+// Every contour of a stroke is added with the same orientation, so that overlapping pieces
+// add up under the winding rule instead of cancelling each other out.
+void add_stroke_polygon(GPath& dst, GPoint pts[], int count) {
+  if (signed_area(pts, count) < 0.0f) std::reverse(pts, pts + count);
+
+  dst.addPolygon(pts, count);
+}
+
+GPoint quad_tangent(const GPoint pts[3], float t) {
+  GVector d = (1 - t) * (pts[1] - pts[0]) + t * (pts[2] - pts[1]);
+  return d.length() > 0.0f ? d : pts[2] - pts[0];
+}
+
+GPoint cubic_tangent(const GPoint pts[4], float t) {
+  GVector d = (1 - t) * (1 - t) * (pts[1] - pts[0]) + 2 * t * (1 - t) * (pts[2] - pts[1]) + t * t * (pts[3] - pts[2]);
+  return d.length() > 0.0f ? d : pts[3] - pts[0];
+}
+
+// A single line, quad or cubic of the contour being stroked
+struct StrokePiece {
+  GPath::Verb verb;
+  GPoint pts[4];
+
+  GPoint start() const { return pts[0]; }
+  GPoint end() const { return pts[(int) verb]; }
+
+  GPoint pointAt(float t) const {
+    if (verb == GPath::kQuad) return get_quad_curve_point(pts, t);
+    if (verb == GPath::kCubic) return get_cubic_curve_point(pts, t);
+    return pts[0] + (pts[1] - pts[0]) * t;
+  }
+
+  GVector tangentAt(float t) const {
+    if (verb == GPath::kQuad) return quad_tangent(pts, t);
+    if (verb == GPath::kCubic) return cubic_tangent(pts, t);
+    return pts[1] - pts[0];
+  }
+
+  // number of quads used to offset a curve; more as the curve bends or the stroke widens
+  int subdivisions(float radius) const {
+    GVector e = { 0, 0 };
+
+    if (verb == GPath::kQuad) {
+      e = pts[0] - 2 * pts[1] + pts[2];
+    } else if (verb == GPath::kCubic) {
+      GVector e0 = pts[0] - 2 * pts[1] + pts[2];
+      GVector e1 = pts[1] - 2 * pts[2] + pts[3];
+      e = { std::max(std::abs(e0.x), std::abs(e1.x)), std::max(std::abs(e0.y), std::abs(e1.y)) };
+    }
+
+    int n = GCeilToInt(sqrtf(e.length() * (1 + radius)));
+    return std::max(1, std::min(n, 64));
+  }
+};
+
+void stroke_line(GPath& dst, GPoint a, GPoint b, float radius) {
+  GVector n = stroke_normal(b - a, radius);
+  GPoint quad[4] = { a + n, b + n, b - n, a - n };
+
+  add_stroke_polygon(dst, quad, 4);
+}
+
+// Offset a curve on both sides, one quadratic per subdivision. The control point of each
+// offset quad is placed so the quad passes through the offset midpoint.
+void stroke_curve(GPath& dst, const StrokePiece& piece, float radius) {
+  int n = piece.subdivisions(radius);
+  float dt = 1.0f / n;
+
+  for (int i = 0; i < n; i++) {
+    float t0 = i * dt;
+    float t1 = (i + 1) * dt;
+    float tm = (t0 + t1) * 0.5f;
+
+    GPoint p0 = piece.pointAt(t0);
+    GPoint pm = piece.pointAt(tm);
+    GPoint p1 = piece.pointAt(t1);
+
+    GVector n0 = stroke_normal(piece.tangentAt(t0), radius);
+    GVector nm = stroke_normal(piece.tangentAt(tm), radius);
+    GVector n1 = stroke_normal(piece.tangentAt(t1), radius);
+
+    GPoint l0 = p0 + n0, l1 = p1 + n1;
+    GPoint r0 = p0 - n0, r1 = p1 - n1;
+    GPoint lc = 2 * (pm + nm) - (l0 + l1) * 0.5f;
+    GPoint rc = 2 * (pm - nm) - (r0 + r1) * 0.5f;
+
+    GPoint hull[6] = { l0, lc, l1, r1, rc, r0 };
+
+    // contours must end on their first point, the edger only closes them after a line
+    dst.moveTo(l0);
+    if (signed_area(hull, 6) >= 0.0f) {
+      dst.quadTo(lc, l1);    dst.lineTo(r1);
+      dst.quadTo(rc, r0);    dst.lineTo(l0);
+    } else {
+      dst.lineTo(r0);        dst.quadTo(rc, r1);
+      dst.lineTo(l1);        dst.quadTo(lc, l0);
+    }
+  }
+}
+
+// The outer wedge of a round join: a pie slice around p from p + n0 to p + n1, with one
+// quad per eighth of a turn like addCircle. The inner side is already covered by the pieces.
+void add_round_wedge(GPath& dst, GPoint p, GVector n0, GVector n1, GVector d0, float radius) {
+  float a0 = atan2f(n0.y, n0.x);
+  float sweep = atan2f(cross(n0, n1), dot(n0, n1));
+
+  // turning straight back, the slice is the half ahead of the incoming piece
+  GVector mid = { cosf(a0 + sweep * 0.5f), sinf(a0 + sweep * 0.5f) };
+  if (dot(mid, d0) < 0.0f) sweep = -sweep;
+
+  // keep the orientation of the other stroke contours
+  if (sweep < 0.0f) {
+    a0 += sweep;
+    sweep = -sweep;
+  }
+
+  int n = std::max(1, GCeilToInt(sweep / (gFloatPI * 0.25f)));
+  float step = sweep / n;
+  float ctrl = radius / cosf(step * 0.5f);
+
+  dst.moveTo(p);
+  dst.lineTo(p + radius * GVector{ cosf(a0), sinf(a0) });
+  for (int i = 0; i < n; i++) {
+    float a = a0 + step * i;
+    dst.quadTo(p + ctrl * GVector{ cosf(a + step * 0.5f), sinf(a + step * 0.5f) },
+               p + radius * GVector{ cosf(a + step), sinf(a + step) });
+  }
+  dst.lineTo(p);
+}
+
+void stroke_join(GPath& dst, GPoint p, GVector d0, GVector d1, float radius, GPath::JoinType join, float miterLimit) {
+  float turn = cross(d0, d1);
+
+  // collinear and heading the same way, the pieces already meet
+  if (std::abs(turn) <= 1e-6f * d0.length() * d1.length() && dot(d0, d1) > 0.0f) return;
+
+  // the outer side of the corner is where the two offsets pull apart
+  float side = turn > 0.0f ? -1.0f : 1.0f;
+  GVector n0 = side * stroke_normal(d0, radius);
+  GVector n1 = side * stroke_normal(d1, radius);
+
+  if (join == GPath::kRound_JoinType) {
+    add_round_wedge(dst, p, n0, n1, d0, radius);
+    return;
+  }
+
+  if (join == GPath::kMiter_JoinType) {
+    GVector mid = n0 + n1;
+    float midLen = mid.length();
+
+    // ratio of miter length to stroke width is 1 / cos(half the turn)
+    float cosHalf = midLen > 0.0f ? dot(mid * (1.0f / midLen), n0) / radius : 0.0f;
+
+    if (cosHalf > 0.0f && 1.0f / cosHalf <= miterLimit) {
+      GPoint tip = p + mid * (radius / (midLen * cosHalf));
+      GPoint miter[4] = { p, p + n0, tip, p + n1 };
+
+      add_stroke_polygon(dst, miter, 4);
+      return;
+    }
+  }
+
+  GPoint bevel[3] = { p, p + n0, p + n1 };
+  add_stroke_polygon(dst, bevel, 3);
+}
+
+// cap at p, where d points out of the contour
+void stroke_cap(GPath& dst, GPoint p, GVector d, float radius, GPath::CapType cap) {
+  if (cap == GPath::kRound_CapType) {
+    dst.addCircle(p, radius, GPath::kCW_Direction);
+  } else if (cap == GPath::kSquare_CapType) {
+    GVector n = stroke_normal(d, radius);
+    GVector out = d * (radius / d.length());
+    GPoint square[4] = { p + n, p + n + out, p - n + out, p - n };
+
+    add_stroke_polygon(dst, square, 4);
+  }
+}
+
+// A contour with no length has no direction for its caps, but they still meet at p:
+// round caps make a dot there and square caps an axis-aligned square.
+void stroke_dot(GPath& dst, GPoint p, float radius, GPath::CapType cap) {
+  if (cap == GPath::kRound_CapType) {
+    dst.addCircle(p, radius, GPath::kCW_Direction);
+  } else if (cap == GPath::kSquare_CapType) {
+    GPoint square[4] = { p + GVector{ -radius, -radius }, p + GVector{ radius, -radius },
+                         p + GVector{ radius, radius }, p + GVector{ -radius, radius } };
+    add_stroke_polygon(dst, square, 4);
+  }
+}
+
+// dotAt is the point of a zero-length piece of the contour, or null if it had none
+void stroke_contour(GPath& dst, std::vector<StrokePiece>& pieces, const GPoint* dotAt, float radius,
+                    GPath::CapType cap, GPath::JoinType join, float miterLimit) {
+  if (pieces.size() == 0) {
+    if (dotAt) stroke_dot(dst, *dotAt, radius, cap);
+    return;
+  }
+
+  bool closed = pieces.front().start() == pieces.back().end();
+
+  for (size_t i = 0; i < pieces.size(); i++) {
+    const StrokePiece& piece = pieces[i];
+
+    if (piece.verb == GPath::kLine) {
+      stroke_line(dst, piece.pts[0], piece.pts[1], radius);
+    } else {
+      stroke_curve(dst, piece, radius);
+    }
+
+    if (i + 1 < pieces.size() || closed) {
+      const StrokePiece& next = pieces[(i + 1) % pieces.size()];
+      stroke_join(dst, piece.end(), piece.tangentAt(1), next.tangentAt(0), radius, join, miterLimit);
+    }
+  }
+
+  if (!closed) {
+    stroke_cap(dst, pieces.front().start(), -1.0f * pieces.front().tangentAt(0), radius, cap);
+    stroke_cap(dst, pieces.back().end(), pieces.back().tangentAt(1), radius, cap);
+  }
+
+  pieces.clear();
+}
+
+GPath GPath::stroke(float width, CapType cap, JoinType join, float miterLimit) const {
+  GPath dst;
+  if (!(width > 0.0f)) return dst;
+
+  float radius = width * 0.5f;
+
+  std::vector<StrokePiece> pieces;
+  GPoint pts[GPath::kMaxNextPoints];
+  GPath::Iter iter(*this);
+  GPoint dotAt;
+  bool hasDot = false;
+
+  while (auto v = iter.next(pts)) {
+    if (v.value() == GPath::kMove) {
+      stroke_contour(dst, pieces, hasDot ? &dotAt : nullptr, radius, cap, join, miterLimit);
+      hasDot = false;
+      continue;
+    }
+
+    StrokePiece piece;
+    piece.verb = v.value();
+    for (int i = 0; i <= (int) piece.verb; i++) piece.pts[i] = pts[i];
+
+    // zero-length pieces have no direction to offset along, but may be all there is
+    if (piece.tangentAt(0).length() == 0.0f) {
+      dotAt = piece.start();
+      hasDot = true;
+      continue;
+    }
+
+    pieces.push_back(piece);
+  }
+
+  stroke_contour(dst, pieces, hasDot ? &dotAt : nullptr, radius, cap, join, miterLimit);
+
+  return dst;
+}
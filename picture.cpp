@@ -0,0 +1,528 @@
+#include "include/GPicture.h"
+#include "include/GBitmap.h"
+#include "include/GPNGWriter.h"
+#include "include/GMatrix.h"
+#include "include/GPath.h"
+#include "include/GReference.h"
+#include "include/GShader.h"
+#include <vector>
+
+namespace {
+
+enum class OpType {
+  kSave, kSaveLayer, kRestore, kConcat, kClipRect, kClipPath,
+  kClear, kConvexPolygon, kPolyline, kPath, kMesh, kQuad,
+};
+
+struct Op {
+  OpType type;
+
+  GMatrix matrix;                 // concat
+  GRect rect;                     // clipRect, and saveLayer if hasRect
+  bool hasRect = false;
+  GColor color;                   // clear
+  GPaint paint;
+  GPath path;                     // clipPath, drawPath
+  std::vector<GPoint> pts;        // polygon, polyline, mesh and quad verts
+  std::vector<GPoint> texs;
+  std::vector<GColor> colors;
+  std::vector<int> indices;
+  int count = 0;                  // mesh triangles, quad level
+
+  // noted while recording, in the picture's device space
+  GMatrix ctm;
+  GIRect bounds;                  // every pixel the draw can touch
+  GIRect opaque;                  // pixels the draw is sure to overwrite, or empty
+  bool inLayer = false;
+
+  bool isDraw() const { return type >= OpType::kClear; }
+};
+
+// what playback does with each op
+struct Cull {
+  bool skip = false;
+  bool clip = false;
+  GIRect clipRect;
+};
+
+GIRect empty_rect() { return GIRect::LTRB(0, 0, 0, 0); }
+
+GIRect intersect_rect(const GIRect& a, const GIRect& b) {
+  GIRect r = GIRect::LTRB(std::max(a.left, b.left), std::max(a.top, b.top),
+                          std::min(a.right, b.right), std::min(a.bottom, b.bottom));
+  return r.isEmpty() ? empty_rect() : r;
+}
+
+bool contains_rect(const GIRect& outer, const GIRect& inner) {
+  return outer.left <= inner.left && outer.top <= inner.top &&
+         outer.right >= inner.right && outer.bottom >= inner.bottom;
+}
+
+int64_t area(const GIRect& r) {
+  return r.isEmpty() ? 0 : (int64_t) r.width() * r.height();
+}
+
+// what is left of r once hole is removed, if that is still a rect (hole spans one side of r)
+bool subtract_rect(const GIRect& r, const GIRect& hole, GIRect* remainder) {
+  bool spansX = hole.left <= r.left && hole.right >= r.right;
+  bool spansY = hole.top <= r.top && hole.bottom >= r.bottom;
+
+  if (spansX && hole.top <= r.top && hole.bottom > r.top) {
+    *remainder = GIRect::LTRB(r.left, hole.bottom, r.right, r.bottom);
+  } else if (spansX && hole.bottom >= r.bottom && hole.top < r.bottom) {
+    *remainder = GIRect::LTRB(r.left, r.top, r.right, hole.top);
+  } else if (spansY && hole.left <= r.left && hole.right > r.left) {
+    *remainder = GIRect::LTRB(hole.right, r.top, r.right, r.bottom);
+  } else if (spansY && hole.right >= r.right && hole.left < r.right) {
+    *remainder = GIRect::LTRB(r.left, r.top, hole.left, r.bottom);
+  } else {
+    return false;
+  }
+  return true;
+}
+
+bool is_axis_aligned(const GMatrix& mat) {
+  return mat[1] == 0.0f && mat[2] == 0.0f;
+}
+
+GIRect mapped_bounds(const GMatrix& mat, const GPoint pts[], int count) {
+  if (count == 0) return empty_rect();
+
+  GPoint p = mat * pts[0];
+  GRect r = GRect::LTRB(p.x, p.y, p.x, p.y);
+
+  for (int i = 1; i < count; i++) {
+    p = mat * pts[i];
+    r = GRect::LTRB(std::min(r.left, p.x), std::min(r.top, p.y),
+                    std::max(r.right, p.x), std::max(r.bottom, p.y));
+  }
+  return r.roundOut();
+}
+
+// the rect covered by 4 points, if they are its corners in order
+bool is_device_rect(const GPoint pts[], int count, GRect* rect) {
+  if (count != 4) return false;
+
+  for (int i = 0; i < 4; i++) {
+    const GPoint& a = pts[i];
+    const GPoint& b = pts[(i + 1) % 4];
+    if ((a.x == b.x) == (a.y == b.y)) return false;
+  }
+
+  *rect = GRect::LTRB(std::min(pts[0].x, pts[2].x), std::min(pts[0].y, pts[2].y),
+                      std::max(pts[0].x, pts[2].x), std::max(pts[0].y, pts[2].y));
+  return !rect->isEmpty();
+}
+
+// true if drawing with the paint leaves nothing of what was below
+bool paint_overwrites(const GPaint& paint) {
+  switch (paint.getBlendMode()) {
+    case GBlendMode::kClear:
+    case GBlendMode::kSrc:
+      return true;
+    case GBlendMode::kSrcOver:
+      if (GShader* sh = paint.getShader()) return sh->isOpaque();
+      return paint.getAlpha() >= 1.0f;
+    default:
+      return false;
+  }
+}
+
+class Picture : public GPicture {
+  public:
+    Picture(std::vector<Op> ops) : fOps(std::move(ops)), fCulls(fOps.size()) {
+      this->cull();
+    }
+
+    int countOps() const override { return (int) fOps.size(); }
+
+    int countCulled() const override {
+      int n = 0;
+      for (const Cull& c : fCulls) n += c.skip;
+      return n;
+    }
+
+    void playback(GCanvas* canvas) const override {
+      // the reference replays every op as recorded
+      if (GGetReferenceMode()) {
+        this->playbackAll(canvas);
+        return;
+      }
+
+      for (size_t i = 0; i < fOps.size(); i++) {
+        const Op& op = fOps[i];
+        const Cull& c = fCulls[i];
+
+        if (c.skip) continue;
+
+        if (c.clip) {
+          // clip in the picture's device space, then draw with the op's own matrix again
+          canvas->save();
+          canvas->concat(*op.ctm.invert());
+          canvas->clipRect(GRect::LTRB(c.clipRect.left, c.clipRect.top, c.clipRect.right, c.clipRect.bottom));
+          canvas->concat(op.ctm);
+          play(canvas, op);
+          canvas->restore();
+        } else {
+          play(canvas, op);
+        }
+      }
+    }
+
+    void playbackAll(GCanvas* canvas) const override {
+      for (const Op& op : fOps) play(canvas, op);
+    }
+
+  private:
+    static constexpr size_t kMaxOccluders = 16;
+
+    std::vector<Op> fOps;
+    std::vector<Cull> fCulls;
+
+    // Walk the draws front-to-back, keeping the largest opaque rects seen so far. Anything
+    // drawn into a layer is left alone, since the layer is composited as a whole later.
+    void cull() {
+      std::vector<GIRect> occluders;
+
+      for (size_t i = fOps.size(); i-- > 0;) {
+        const Op& op = fOps[i];
+        if (!op.isDraw() || op.inLayer) continue;
+
+        Cull& c = fCulls[i];
+
+        if (op.bounds.isEmpty()) {
+          c.skip = true;
+          continue;
+        }
+
+        // trimming by one occluder can let another trim (or hide) the rest
+        GIRect visible = op.bounds;
+        bool trimmed = true;
+        while (trimmed && !c.skip) {
+          trimmed = false;
+          for (const GIRect& occ : occluders) {
+            if (contains_rect(occ, visible)) {
+              c.skip = true;
+              break;
+            }
+
+            GIRect remainder;
+            if (subtract_rect(visible, occ, &remainder) && area(remainder) < area(visible)) {
+              visible = remainder;
+              trimmed = true;
+            }
+          }
+        }
+        if (c.skip) continue;
+
+        if (area(visible) < area(op.bounds) && is_axis_aligned(op.ctm) && op.ctm.invert()) {
+          c.clip = true;
+          c.clipRect = visible;
+        }
+
+        if (!op.opaque.isEmpty()) {
+          add_occluder(occluders, op.opaque);
+        }
+      }
+    }
+
+    static void add_occluder(std::vector<GIRect>& occluders, const GIRect& r) {
+      if (occluders.size() < kMaxOccluders) {
+        occluders.push_back(r);
+        return;
+      }
+
+      size_t smallest = 0;
+      for (size_t i = 1; i < occluders.size(); i++) {
+        if (area(occluders[i]) < area(occluders[smallest])) smallest = i;
+      }
+      if (area(r) > area(occluders[smallest])) occluders[smallest] = r;
+    }
+
+    static void play(GCanvas* canvas, const Op& op) {
+      switch (op.type) {
+        case OpType::kSave:      canvas->save(); break;
+        case OpType::kSaveLayer: canvas->saveLayer(op.hasRect ? &op.rect : nullptr, op.paint); break;
+        case OpType::kRestore:   canvas->restore(); break;
+        case OpType::kConcat:    canvas->concat(op.matrix); break;
+        case OpType::kClipRect:  canvas->clipRect(op.rect); break;
+        case OpType::kClipPath:  canvas->clipPath(op.path); break;
+        case OpType::kClear:     canvas->clear(op.color); break;
+        case OpType::kConvexPolygon:
+          canvas->drawConvexPolygon(op.pts.data(), (int) op.pts.size(), op.paint);
+          break;
+        case OpType::kPolyline:
+          canvas->drawPolyline(op.pts.data(), (int) op.pts.size(), op.paint);
+          break;
+        case OpType::kPath:      canvas->drawPath(op.path, op.paint); break;
+        case OpType::kMesh:
+          canvas->drawMesh(op.pts.data(), op.colors.empty() ? nullptr : op.colors.data(),
+                           op.texs.empty() ? nullptr : op.texs.data(), op.count,
+                           op.indices.data(), op.paint);
+          break;
+        case OpType::kQuad:
+          canvas->drawQuad(op.pts.data(), op.colors.empty() ? nullptr : op.colors.data(),
+                           op.texs.empty() ? nullptr : op.texs.data(), op.count, op.paint);
+          break;
+      }
+    }
+};
+
+// Records calls, tracking just enough of the CTM and clip to know where each draw lands
+class RecordingCanvas : public GCanvas {
+  public:
+    RecordingCanvas(int width, int height) {
+      fStates.push_back({ GMatrix(), GIRect::WH(width, height), true, false });
+    }
+
+    std::vector<Op> detach() { return std::move(fOps); }
+
+    void save() override {
+      this->record(OpType::kSave);
+      fStates.push_back(fStates.back());
+    }
+
+    void saveLayer(const GRect* bounds, const GPaint& paint) override {
+      Op& op = this->record(OpType::kSaveLayer);
+      op.paint = paint;
+      if (bounds) {
+        op.rect = *bounds;
+        op.hasRect = true;
+      }
+      fStates.push_back(fStates.back());
+      fStates.back().inLayer = true;
+    }
+
+    void restore() override {
+      this->record(OpType::kRestore);
+      fStates.pop_back();
+    }
+
+    void concat(const GMatrix& matrix) override {
+      this->record(OpType::kConcat).matrix = matrix;
+      fStates.back().ctm = fStates.back().ctm * matrix;
+    }
+
+    void clipRect(const GRect& rect) override {
+      this->record(OpType::kClipRect).rect = rect;
+
+      State& s = fStates.back();
+      const GPoint pts[4] = {
+        { rect.left, rect.top }, { rect.right, rect.top },
+        { rect.right, rect.bottom }, { rect.left, rect.bottom }
+      };
+
+      if (is_axis_aligned(s.ctm)) {
+        // matches how the canvas rounds a rect clip
+        GPoint a = s.ctm * pts[0];
+        GPoint b = s.ctm * pts[2];
+        GRect dev = GRect::LTRB(std::min(a.x, b.x), std::min(a.y, b.y),
+                                std::max(a.x, b.x), std::max(a.y, b.y));
+        s.clip = intersect_rect(s.clip, dev.round());
+      } else {
+        s.clip = intersect_rect(s.clip, mapped_bounds(s.ctm, pts, 4));
+        s.clipIsRect = false;
+      }
+    }
+
+    void clipPath(const GPath& path) override {
+      this->record(OpType::kClipPath).path = path;
+
+      // an inverse clip keeps everything outside the path, so it can't shrink the bounds
+      State& s = fStates.back();
+      if (!path.isInverseFillType()) {
+        s.clip = intersect_rect(s.clip, path_bounds(s.ctm, path));
+      }
+      s.clipIsRect = false;
+    }
+
+    GIRect getDamage() const override { return fDamage; }
+    void resetDamage() override { fDamage = empty_rect(); }
+
+    void clear(const GColor& color) override {
+      Op& op = this->record(OpType::kClear);
+      op.color = color;
+      this->noteDraw(op, fStates.back().clip, true);
+    }
+
+    void drawRect(const GRect& rect, const GPaint& paint) override {
+      const GPoint pts[4] = {
+        { rect.left, rect.top }, { rect.right, rect.top },
+        { rect.right, rect.bottom }, { rect.left, rect.bottom }
+      };
+      this->drawConvexPolygon(pts, 4, paint);
+    }
+
+    void drawConvexPolygon(const GPoint pts[], int count, const GPaint& paint) override {
+      Op& op = this->record(OpType::kConvexPolygon);
+      op.pts.assign(pts, pts + count);
+      op.paint = paint;
+
+      const GMatrix& ctm = fStates.back().ctm;
+      GIRect bounds = count < 3 ? empty_rect() : mapped_bounds(ctm, pts, count);
+      this->noteDraw(op, bounds, false);
+
+      // only a device-aligned rect is simple enough to know exactly which pixels it covers
+      GPoint dev[4];
+      GRect rect;
+      if (count == 4 && paint_overwrites(paint)) {
+        ctm.mapPoints(dev, pts, 4);
+        if (is_device_rect(dev, 4, &rect)) {
+          this->noteOpaque(op, GIRect::LTRB(GCeilToInt(rect.left), GCeilToInt(rect.top),
+                                            GFloorToInt(rect.right), GFloorToInt(rect.bottom)));
+        }
+      }
+    }
+
+    void drawPolyline(const GPoint pts[], int count, const GPaint& paint) override {
+      Op& op = this->record(OpType::kPolyline);
+      op.pts.assign(pts, pts + count);
+      op.paint = paint;
+
+      // the pixel holding the last point can be plotted too
+      GIRect r = mapped_bounds(fStates.back().ctm, pts, count);
+      this->noteDraw(op, GIRect::LTRB(r.left, r.top, r.right + 1, r.bottom + 1), false);
+    }
+
+    void drawPath(const GPath& path, const GPaint& paint) override {
+      Op& op = this->record(OpType::kPath);
+      op.path = path;
+      op.paint = paint;
+
+      const State& s = fStates.back();
+      this->noteDraw(op, path.isInverseFillType() ? s.clip : path_bounds(s.ctm, path), false);
+    }
+
+    void drawMesh(const GPoint verts[], const GColor colors[], const GPoint texs[],
+                  int count, const int indices[], const GPaint& paint) override {
+      Op& op = this->record(OpType::kMesh);
+
+      int n = 0;
+      for (int i = 0; i < count * 3; i++) n = std::max(n, indices[i] + 1);
+
+      op.pts.assign(verts, verts + n);
+      if (colors) op.colors.assign(colors, colors + n);
+      if (texs) op.texs.assign(texs, texs + n);
+      op.indices.assign(indices, indices + count * 3);
+      op.count = count;
+      op.paint = paint;
+
+      this->noteDraw(op, mapped_bounds(fStates.back().ctm, verts, n), false);
+    }
+
+    void drawQuad(const GPoint verts[4], const GColor colors[4], const GPoint texs[4],
+                  int level, const GPaint& paint) override {
+      Op& op = this->record(OpType::kQuad);
+      op.pts.assign(verts, verts + 4);
+      if (colors) op.colors.assign(colors, colors + 4);
+      if (texs) op.texs.assign(texs, texs + 4);
+      op.count = level;
+      op.paint = paint;
+
+      this->noteDraw(op, mapped_bounds(fStates.back().ctm, verts, 4), false);
+    }
+
+  private:
+    struct State {
+      GMatrix ctm;
+      GIRect clip;          // bounds of the clip in device space
+      bool clipIsRect;      // whether the clip is exactly those bounds
+      bool inLayer;
+    };
+
+    std::vector<State> fStates;
+    std::vector<Op> fOps;
+    GIRect fDamage = empty_rect();
+
+    Op& record(OpType type) {
+      fOps.push_back(Op());
+      Op& op = fOps.back();
+      op.type = type;
+      op.ctm = fStates.back().ctm;
+      op.inLayer = fStates.back().inLayer;
+      return op;
+    }
+
+    // bounds of the path's points, which contain its curves too
+    static GIRect path_bounds(const GMatrix& ctm, const GPath& path) {
+      std::vector<GPoint> pts;
+      GPoint p[GPath::kMaxNextPoints];
+      GPath::Iter iter(path);
+
+      while (auto verb = iter.next(p)) {
+        switch (*verb) {
+          case GPath::kMove:  pts.push_back(p[0]); break;
+          case GPath::kLine:  pts.push_back(p[1]); break;
+          case GPath::kQuad:  pts.insert(pts.end(), p + 1, p + 3); break;
+          case GPath::kCubic: pts.insert(pts.end(), p + 1, p + 4); break;
+        }
+      }
+      return mapped_bounds(ctm, pts.data(), (int) pts.size());
+    }
+
+    void noteDraw(Op& op, const GIRect& bounds, bool overwrites) {
+      const State& s = fStates.back();
+      op.bounds = intersect_rect(bounds, s.clip);
+      op.opaque = empty_rect();
+
+      if (overwrites) this->noteOpaque(op, op.bounds);
+
+      if (!s.inLayer) {
+        const GIRect& r = op.bounds;
+        if (fDamage.isEmpty()) {
+          fDamage = r;
+        } else if (!r.isEmpty()) {
+          fDamage = GIRect::LTRB(std::min(fDamage.left, r.left), std::min(fDamage.top, r.top),
+                                 std::max(fDamage.right, r.right), std::max(fDamage.bottom, r.bottom));
+        }
+      }
+    }
+
+    // opaque pixels can only be trusted when the clip is exactly its bounds
+    void noteOpaque(Op& op, const GIRect& rect) {
+      const State& s = fStates.back();
+      if (s.clipIsRect) op.opaque = intersect_rect(rect, s.clip);
+    }
+};
+
+}
+
+GPictureRecorder::GPictureRecorder() {}
+GPictureRecorder::~GPictureRecorder() {}
+
+GCanvas* GPictureRecorder::beginRecording(int width, int height) {
+  fRecorder.reset(new RecordingCanvas(width, height));
+  return fRecorder.get();
+}
+
+std::unique_ptr<GPicture> GPictureRecorder::finishRecording() {
+  if (!fRecorder) return nullptr;
+
+  std::vector<Op> ops = static_cast<RecordingCanvas*>(fRecorder.get())->detach();
+  fRecorder.reset();
+  return std::unique_ptr<GPicture>(new Picture(std::move(ops)));
+}
+
+bool GWritePictureStrips(const GPicture& picture, int width, int height, int stripHeight, const char path[]) {
+  stripHeight = std::max(1, std::min(stripHeight, height));
+
+  GPNGWriter writer;
+  if (!writer.begin(path, width, height)) return false;
+
+  GBitmap strip;
+  strip.alloc(width, stripHeight);
+
+  bool ok = true;
+  for (int top = 0; ok && top < height; top += stripHeight) {
+    memset(strip.pixels(), 0, strip.rowBytes() * stripHeight);
+
+    auto canvas = GCreateCanvas(strip);
+    canvas->concat(GMatrix::Translate(0, (float) -top));
+    picture.playback(canvas.get());
+
+    ok = writer.writeRows(strip, std::min(stripHeight, height - top));
+  }
+  free(strip.pixels());
+
+  return writer.end() && ok;
+}
@@ -1,4 +1,16 @@
 #include "include/GPoint.h"
+#include "include/GRect.h"
+
+// smallest rect containing all of the points
+GRect points_bounds(const GPoint pts[], int count) {
+  GRect r = GRect::LTRB(pts[0].x, pts[0].y, pts[0].x, pts[0].y);
+
+  for (int i = 1; i < count; i++) {
+    r = GRect::LTRB(std::min(r.left, pts[i].x), std::min(r.top, pts[i].y),
+                    std::max(r.right, pts[i].x), std::max(r.bottom, pts[i].y));
+  }
+  return r;
+}
 
 float compute_x(const GPoint& a, const GPoint& b, float y) {
   return a.x + (b.x - a.x) * (y - a.y) / (b.y - a.y);
@@ -3,6 +3,7 @@
 
 #include "include/GShader.h"
 #include "include/GMatrix.h"
+#include "include/GReference.h"
 #include "clipping.h"
 
 /**
@@ -35,6 +36,14 @@ class MyShader : public GShader {
      *  can hold at least [count] entries.
      */
 
+    bool describe(GShaderDesc* desc) const override {
+      desc->type = GShaderDesc::kBitmap;
+      desc->tileMode = fTileMode;
+      desc->bitmap = &fDevice;
+      desc->localMatrix = fMat;
+      return true;
+    }
+
     // update to adjust for tile modes
     void shadeRow(int x, int y, int count, GPixel row[]) override { 
 
@@ -42,11 +51,14 @@ class MyShader : public GShader {
       float xp = fInv[0] * (x + 0.5f) + fInv[2] * (y + 0.5f) + fInv[4];
       float yp = fInv[1] * (x + 0.5f) + fInv[3] * (y + 0.5f) + fInv[5];
 
+      // an unrotated row keeps the same source y, so it is looked up once
+      const bool fixedY = fInv[1] == 0.0f && !GGetReferenceMode();
+
       switch(fTileMode) {
         case GTileMode::kClamp:
 
           // y never changes
-          if (fInv[1] == 0.0f) {
+          if (fixedY) {
             int currY = clampY(fDevice, GFloorToInt(yp));
             
             for (int i = 0; i < count; i++) {
@@ -79,7 +91,7 @@ class MyShader : public GShader {
         
         case GTileMode::kMirror:
           // y never changes
-          if (fInv[1] == 0.0f) {
+          if (fixedY) {
             int currY = mirrorY(fDevice, GFloorToInt(yp));
             
             for (int i = 0; i < count; i++) {
@@ -110,7 +122,7 @@ class MyShader : public GShader {
 
         case GTileMode::kRepeat:
         // y never changes
-          if (fInv[1] == 0.0f) {
+          if (fixedY) {
             int currY = repeatY(fDevice, GFloorToInt(yp));
             
             for (int i = 0; i < count; i++) {
@@ -170,6 +182,13 @@ GPixel ctp(const GColor& color) {
   return GPixel_PackARGB(a, r, g, b);
 }
 
+// premultiply into any kind of pixel (A8 keeps just the alpha)
+void store_color(const GColor& color, GPixel* dst) { *dst = ctp(color); }
+void store_color(const GColor& color, GPixelF* dst) {
+  *dst = { color.r * color.a, color.g * color.a, color.b * color.a, color.a };
+}
+void store_color(const GColor& color, GPixelA8* dst) { *dst = GRoundToInt(color.a * 255); }
+
 GColor clamp_color(const GColor color) {
   GColor col;
   col.a = color.a >= 1.0f ? 1.0f : (color.a <= 0.0f ? 0.0f : color.a);
@@ -222,9 +241,25 @@ class MyGradientShader : public GShader {
      *  corresponding src pixels in row[0...count - 1]. The caller must ensure that row[]
      *  can hold at least [count] entries.
      */
-    void shadeRow(int x, int y, int count, GPixel row[]) override { 
+    void shadeRow(int x, int y, int count, GPixel row[]) override { this->shade(x, y, count, row); }
+    void shadeRowF(int x, int y, int count, GPixelF row[]) override { this->shade(x, y, count, row); }
+    void shadeRowA8(int x, int y, int count, GPixelA8 row[]) override { this->shade(x, y, count, row); }
+
+    // the colors as clamped, which makes the same gradient
+    bool describe(GShaderDesc* desc) const override {
+      desc->type = GShaderDesc::kLinearGradient;
+      desc->tileMode = fTileMode;
+      desc->p0 = fP0;
+      desc->p1 = fP1;
+      desc->colors.assign(fColors.begin(), fColors.begin() + fCount);
+      return true;
+    }
+
+  private:
+    template <typename Pixel> void shade(int x, int y, int count, Pixel row[]) {
       if (fCount == 1) {
-        GPixel pix = ctp(fColors[0]);
+        Pixel pix;
+        store_color(fColors[0], &pix);
         for (int i = 0; i < count; i++) row[i] = pix;
         return;
       }
@@ -255,7 +290,7 @@ class MyGradientShader : public GShader {
 
             assert(mix.a <= 1.0f && mix.r <= 1.0f && mix.g <= 1.0f && mix.b <= 1.0f);
 
-            row[i] = ctp(mix);
+            store_color(mix, &row[i]);
 
             xpr += fInv[0] * (fCount - 1);
           }
@@ -281,7 +316,7 @@ class MyGradientShader : public GShader {
 
             assert(mix.a <= 1.0f && mix.r <= 1.0f && mix.g <= 1.0f && mix.b <= 1.0f);
 
-            row[i] = ctp(mix);
+            store_color(mix, &row[i]);
 
             xpr += fInv[0] * (fCount - 1);
           }
@@ -303,7 +338,7 @@ class MyGradientShader : public GShader {
 
             assert(mix.a <= 1.0f && mix.r <= 1.0f && mix.g <= 1.0f && mix.b <= 1.0f);
 
-            row[i] = ctp(mix);
+            store_color(mix, &row[i]);
 
             xpr += fInv[0] * (fCount - 1);
           }
@@ -315,7 +350,6 @@ class MyGradientShader : public GShader {
 
     }
 
-  private:
     const GPoint fP0;
     const GPoint fP1;
     int fCount;
@@ -358,8 +392,12 @@ class TriangleGradientShader : public GShader {
       return false;
     }
 
-    void shadeRow(int x, int y, int count, GPixel row[]) override {
-      
+    void shadeRow(int x, int y, int count, GPixel row[]) override { this->shade(x, y, count, row); }
+    void shadeRowF(int x, int y, int count, GPixelF row[]) override { this->shade(x, y, count, row); }
+    void shadeRowA8(int x, int y, int count, GPixelA8 row[]) override { this->shade(x, y, count, row); }
+
+  private:
+    template <typename Pixel> void shade(int x, int y, int count, Pixel row[]) {
       GPoint p = {x + 0.5f, y + 0.5f};
       GPoint pp;
 
@@ -369,23 +407,24 @@ class TriangleGradientShader : public GShader {
 
         pp = fInv * p;
 
-        pp.x = pp.x < 0.0f ? 0.0f : (pp.x > 1.0f ? 1.0f : pp.x);
-        pp.y = pp.y < 0.0f ? 0.0f : (pp.y > 1.0f ? 1.0f : pp.y);
+        // written so a NaN (from the inverse of a huge or sliver triangle) pins to 0
+        pp.x = pp.x > 0.0f ? (pp.x < 1.0f ? pp.x : 1.0f) : 0.0f;
+        pp.y = pp.y > 0.0f ? (pp.y < 1.0f ? pp.y : 1.0f) : 0.0f;
 
-        c = pp.x * fCols[1] + pp.y * fCols[2] + (1 - pp.x - pp.y) * fCols[0];
+        // pp is clamped per axis, so past the far edge the weights can leave [0, 1]
+        c = clamp_color(pp.x * fCols[1] + pp.y * fCols[2] + (1 - pp.x - pp.y) * fCols[0]);
 
         assert(c.a <= 1.0f);
         assert(c.r <= 1.0f);
         assert(c.g <= 1.0f);
         assert(c.b <= 1.0f);
 
-        row[i] = ctp(c);
+        store_color(c, &row[i]);
         p.x += 1.0f;
         // c += fDiffC;
       }
     }
 
-  private:
     const GPoint fP0;
     const GPoint fP1;
     const GPoint fP2;
@@ -438,6 +477,31 @@ public:
         row[i] = GPixel_PackARGB(a, r, g, b);
       }
     }
+
+    void shadeRowF(int x, int y, int count, GPixelF row[]) override {
+      GPixelF row1[count];
+      GPixelF row2[count];
+
+      fShader1->shadeRowF(x, y, count, row1);
+      fShader2->shadeRowF(x, y, count, row2);
+
+      for (int i = 0; i < count; i++) {
+        row[i] = { row1[i].r * row2[i].r, row1[i].g * row2[i].g,
+                   row1[i].b * row2[i].b, row1[i].a * row2[i].a };
+      }
+    }
+
+    void shadeRowA8(int x, int y, int count, GPixelA8 row[]) override {
+      GPixelA8 row1[count];
+      GPixelA8 row2[count];
+
+      fShader1->shadeRowA8(x, y, count, row1);
+      fShader2->shadeRowA8(x, y, count, row2);
+
+      for (int i = 0; i < count; i++) {
+        row[i] = GDivide255(row1[i] * row2[i]);
+      }
+    }
 };
 
 std::unique_ptr<GShader> GCreateComposeShader(GShader* sh1, GShader* sh2) {
@@ -460,6 +524,14 @@ public:
     void shadeRow(int x, int y, int count, GPixel row[]) override {
         fRealShader->shadeRow(x, y, count, row);
     }
+
+    void shadeRowF(int x, int y, int count, GPixelF row[]) override {
+        fRealShader->shadeRowF(x, y, count, row);
+    }
+
+    void shadeRowA8(int x, int y, int count, GPixelA8 row[]) override {
+        fRealShader->shadeRowA8(x, y, count, row);
+    }
 };
 
 std::unique_ptr<GShader> GCreateProxyShader(const GPoint pts[3], const GPoint texs[3], GShader* origShader) {
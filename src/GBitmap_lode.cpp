@@ -3,88 +3,598 @@
  */
 
 #include "../include/GBitmap.h"
+#include "../include/GPNGWriter.h"
 #include "lodepng.h"
+#include <algorithm>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+
+// gUnpremul[a] = ceil(2^24 / a), so that (c * 255 + a/2) / a == ((c * 255 + a/2) * gUnpremul[a]) >> 24
+// for every c <= a, without overflowing 32 bits. gUnpremul[0] = 0 maps the (zero) colors to 0.
+struct UnpremulTable {
+    uint32_t fScale[256];
+
+    UnpremulTable() {
+        fScale[0] = 0;
+        for (unsigned a = 1; a < 256; ++a) {
+            fScale[a] = ((1u << 24) + a - 1) / a;
+        }
+    }
+};
 
 static void convertToPNG(const GPixel src[], int width, uint8_t dst[]) {
+    static const UnpremulTable gUnpremul;
+
     for (int i = 0; i < width; i++) {
         GPixel c = *src++;
-        int a = GPixel_GetA(c);
-        int r = GPixel_GetR(c);
-        int g = GPixel_GetG(c);
-        int b = GPixel_GetB(c);
-        
+        unsigned a = GPixel_GetA(c);
+        uint32_t scale = gUnpremul.fScale[a];
+        uint32_t half = a >> 1;
+
         // PNG requires unpremultiplied, but GPixel is premultiplied
-        if (0 != a && 255 != a) {
-            r = (r * 255 + a/2) / a;
-            g = (g * 255 + a/2) / a;
-            b = (b * 255 + a/2) / a;
-        }
-        *dst++ = r;
-        *dst++ = g;
-        *dst++ = b;
+        *dst++ = ((GPixel_GetR(c) * 255 + half) * scale) >> 24;
+        *dst++ = ((GPixel_GetG(c) * 255 + half) * scale) >> 24;
+        *dst++ = ((GPixel_GetB(c) * 255 + half) * scale) >> 24;
         *dst++ = a;
     }
 }
 
-bool GBitmap::writeToFile(const char path[]) const {
-    size_t rb = this->width() * 4;
-    uint8_t* pix = (uint8_t*)malloc(this->height() * rb);
-    if (!pix) {
-        return false;
+bool GBitmap::writeToFile(const char path[], PNGLevel level, int threads) const {
+    GPNGWriter writer;
+    return writer.begin(path, this->width(), this->height(), level, threads) &&
+           writer.writeRows(*this, this->height()) &&
+           writer.end();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+// The PNG filters (bpp = 4), applied to row x given the previous row p.
+
+static uint8_t paeth(int a, int b, int c) {
+    int p = a + b - c;
+    int pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+    if (pa <= pb && pa <= pc) return a;
+    return pb <= pc ? b : c;
+}
+
+template <typename Pred> void filter_row(const uint8_t x[], const uint8_t p[], size_t n, uint8_t dst[], Pred pred) {
+    for (size_t i = 0; i < 4 && i < n; ++i) {
+        dst[i] = x[i] - pred(0, p[i], 0);
     }
+    for (size_t i = 4; i < n; ++i) {
+        dst[i] = x[i] - pred(x[i - 4], p[i], p[i - 4]);
+    }
+}
 
-    const GPixel* src = this->pixels();
-    uint8_t* dst = pix;
-    for (int y = 0; y < this->height(); ++y) {
-        convertToPNG(src, this->width(), dst);
-        src += this->rowBytes() / 4;
-        dst += rb;
+static void filter_row(int type, const uint8_t x[], const uint8_t p[], size_t n, uint8_t dst[]) {
+    switch (type) {
+        case 0: memcpy(dst, x, n); break;
+        case 1: filter_row(x, p, n, dst, [](int left, int up, int upLeft) { return left; }); break;
+        case 2: filter_row(x, p, n, dst, [](int left, int up, int upLeft) { return up; }); break;
+        case 3: filter_row(x, p, n, dst, [](int left, int up, int upLeft) { return (left + up) >> 1; }); break;
+        case 4: filter_row(x, p, n, dst, [](int left, int up, int upLeft) { return paeth(left, up, upLeft); }); break;
     }
+}
+
+// Try the filters, and keep the one with the smallest sum of (signed) residuals: the usual
+// heuristic, and the one lodepng uses for RGBA.
+static void filter_row_best(const uint8_t x[], const uint8_t p[], size_t n, uint8_t dst[],
+                            const std::vector<int>& types, std::vector<uint8_t>& tmp) {
+    tmp.resize(n);
+    uint64_t bestSum = ~(uint64_t)0;
+    for (int type : types) {
+        filter_row(type, x, p, n, tmp.data());
 
-    unsigned err = lodepng_encode32_file(path, pix, this->width(), this->height());
-    free(pix);
-    return err == 0;
+        uint64_t sum = 0;
+        for (size_t i = 0; i < n; ++i) {
+            sum += abs((int8_t)tmp[i]);
+        }
+        if (sum < bestSum) {
+            bestSum = sum;
+            dst[0] = type;
+            memcpy(dst + 1, tmp.data(), n);
+        }
+    }
 }
 
-///////////////////////////////////////////////////////////////////////////////
+// Deflate (RFC 1951). Rows are compressed in chunks, each one block with its own Huffman codes
+// built from the symbol counts of that chunk, followed by a sync flush (an empty stored block)
+// so it ends on a byte boundary. Chunks don't refer to each other's bytes, so they can be
+// compressed on separate threads and concatenated.
+
+static const uint16_t gLengthBase[] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115,
+    131, 163, 195, 227, 258,
+};
+static const uint8_t gLengthExtra[] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0,
+};
+static const uint16_t gDistBase[] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537,
+    2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577,
+};
+static const uint8_t gDistExtra[] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13,
+};
 
-static int alpha_mul(unsigned a, unsigned c) {
-    return (a * c + 127) / 255;
+// the order the code length code lengths are stored in
+static const uint8_t gCodeLengthOrder[] = {
+    16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15,
+};
+
+static int code_index(const uint16_t base[], int count, int value) {
+    int i = count - 1;
+    while (base[i] > value) --i;
+    return i;
 }
 
-static void swizzle_rgba_row(GPixel dst[], const uint8_t src[], int count) {
+// A literal (dist == 0) or a match.
+struct Token {
+    uint16_t value;     // literal byte, or match length
+    uint16_t dist;
+};
+
+// Canonical Huffman codes for the given lengths (RFC 1951, 3.2.2), bit-reversed since deflate
+// writes them msb first.
+static void canonical_codes(const unsigned lengths[], int count, uint16_t codes[]) {
+    unsigned lengthCount[16] = {}, next[16] = {};
     for (int i = 0; i < count; ++i) {
+        lengthCount[lengths[i]] += 1;
+    }
+    lengthCount[0] = 0;
+
+    unsigned code = 0;
+    for (int bits = 1; bits < 16; ++bits) {
+        code = (code + lengthCount[bits - 1]) << 1;
+        next[bits] = code;
+    }
+    for (int i = 0; i < count; ++i) {
+        unsigned len = lengths[i];
+        if (len) {
+            unsigned c = next[len]++, r = 0;
+            for (unsigned b = 0; b < len; ++b) {
+                r = (r << 1) | ((c >> b) & 1);
+            }
+            codes[i] = (uint16_t)r;
+        }
+    }
+}
+
+static uint32_t adler32(uint32_t adler, const uint8_t data[], size_t size) {
+    uint32_t a = adler & 0xFFFF, b = adler >> 16;
+    while (size > 0) {
+        size_t n = size < 5552 ? size : 5552;   // the most bytes before b can overflow
+        size -= n;
+        while (n--) {
+            a += *data++;
+            b += a;
+        }
+        a %= 65521;
+        b %= 65521;
+    }
+    return (b << 16) | a;
+}
+
+// The adler32 of A followed by B, given adler32(A), adler32(B) and B's length (as in zlib).
+static uint32_t adler32_combine(uint32_t adlerA, uint32_t adlerB, size_t lengthB) {
+    const uint64_t kBase = 65521;
+    uint64_t rem = lengthB % kBase;
+    uint64_t a = adlerA & 0xFFFF;
+    uint64_t b = (rem * a) % kBase;
+
+    a += (adlerB & 0xFFFF) + kBase - 1;
+    b += (adlerA >> 16) + (adlerB >> 16) + kBase - rem;
+    a %= kBase;
+    b %= kBase;
+    return (uint32_t)((b << 16) | a);
+}
+
+struct BitWriter {
+    std::vector<uint8_t>& fOut;
+    uint64_t fBits = 0;
+    int      fCount = 0;
+
+    BitWriter(std::vector<uint8_t>& out) : fOut(out) {}
+
+    void put(uint32_t bits, int count) {
+        fBits |= (uint64_t)bits << fCount;
+        fCount += count;
+        while (fCount >= 8) {
+            fOut.push_back((uint8_t)fBits);
+            fBits >>= 8;
+            fCount -= 8;
+        }
+    }
+
+    void align() {
+        if (fCount > 0) {
+            this->put(0, 8 - fCount);
+        }
+    }
+
+    // an empty non-final stored block: its header, padding, then LEN = 0 and NLEN = ~0
+    void syncFlush() {
+        this->put(0, 3);
+        this->align();
+        const uint8_t lens[] = { 0x00, 0x00, 0xFF, 0xFF };
+        fOut.insert(fOut.end(), lens, lens + 4);
+    }
+};
+
+GPNGWriter::GPNGWriter() : fFile(nullptr), fWidth(0), fHeight(0), fRowsWritten(0),
+                           fLevel(GBitmap::kDefault_PNGLevel), fThreads(1), fAdler(1) {}
+
+GPNGWriter::~GPNGWriter() {
+    this->close();
+}
+
+void GPNGWriter::close() {
+    if (fFile) {
+        fclose(fFile);
+        fFile = nullptr;
+    }
+}
+
+// typeAndData is the 4-byte chunk type followed by the data; size counts both
+static bool write_chunk(FILE* file, const uint8_t typeAndData[], size_t size) {
+    size_t len = size - 4;
+    unsigned crc = lodepng_crc32(typeAndData, size);
+    uint8_t header[4] = { (uint8_t)(len >> 24), (uint8_t)(len >> 16), (uint8_t)(len >> 8), (uint8_t)len };
+    uint8_t footer[4] = { (uint8_t)(crc >> 24), (uint8_t)(crc >> 16), (uint8_t)(crc >> 8), (uint8_t)crc };
+
+    return fwrite(header, 1, 4, file) == 4 &&
+           fwrite(typeAndData, 1, size, file) == size &&
+           fwrite(footer, 1, 4, file) == 4;
+}
+
+// write the whole bytes deflated so far as an IDAT chunk
+bool GPNGWriter::flushChunk() {
+    if (fChunk.size() <= 4) {
+        return true;
+    }
+    memcpy(fChunk.data(), "IDAT", 4);
+    bool ok = write_chunk(fFile, fChunk.data(), fChunk.size());
+    fChunk.resize(4);
+    return ok;
+}
+
+// Find matches with a hash of the next 3 bytes and a short chain of earlier positions, only
+// within data, so each call stands alone.
+static void find_matches(const uint8_t data[], size_t size, int maxChain, std::vector<Token>& tokens) {
+    enum {
+        kWindow = 32768,
+        kHashBits = 15,
+        kMinMatch = 3,
+        kMaxMatch = 258,
+    };
+    std::vector<int32_t> head(1 << kHashBits, -1);
+    std::vector<int32_t> prev(kWindow, -1);
+
+    auto hash = [data](size_t i) {
+        return ((data[i] << 10) ^ (data[i + 1] << 5) ^ data[i + 2]) & ((1 << kHashBits) - 1);
+    };
+    auto insert = [&](size_t i) {
+        if (i + kMinMatch <= size) {
+            int h = hash(i);
+            prev[i & (kWindow - 1)] = head[h];
+            head[h] = (int32_t)i;
+        }
+    };
+
+    size_t i = 0;
+    while (i < size) {
+        int bestLen = 0, bestDist = 0;
+
+        if (i + kMinMatch <= size) {
+            size_t maxLen = std::min<size_t>(kMaxMatch, size - i);
+            int32_t cand = head[hash(i)];
+            for (int chain = 0; cand >= 0 && i - cand <= kWindow && chain < maxChain; ++chain) {
+                size_t len = 0;
+                while (len < maxLen && data[cand + len] == data[i + len]) ++len;
+                if ((int)len > bestLen) {
+                    bestLen = (int)len;
+                    bestDist = (int)(i - cand);
+                    if (len == maxLen) break;
+                }
+                cand = prev[cand & (kWindow - 1)];
+            }
+        }
+
+        if (bestLen >= kMinMatch) {
+            tokens.push_back({ (uint16_t)bestLen, (uint16_t)bestDist });
+            for (int k = 0; k < bestLen; ++k) {
+                insert(i + k);
+            }
+            i += bestLen;
+        } else {
+            tokens.push_back({ data[i], 0 });
+            insert(i);
+            i += 1;
+        }
+    }
+}
+
+// Compress data as one non-final block with dynamic codes (BTYPE = 10).
+static void deflate_block(const uint8_t data[], size_t size, int maxChain, BitWriter& out) {
+    std::vector<Token> tokens;
+    tokens.reserve(size / 4);
+    find_matches(data, size, maxChain, tokens);
+
+    unsigned litFreq[286] = {}, distFreq[30] = {};
+    for (const Token& t : tokens) {
+        if (t.dist) {
+            litFreq[257 + code_index(gLengthBase, 29, t.value)] += 1;
+            distFreq[code_index(gDistBase, 30, t.dist)] += 1;
+        } else {
+            litFreq[t.value] += 1;
+        }
+    }
+    litFreq[256] = 1;
+
+    unsigned lengths[286 + 30];
+    unsigned* litLen = lengths;
+    unsigned* distLen = lengths + 286;
+    lodepng_huffman_code_lengths(litLen, litFreq, 286, 15);
+    lodepng_huffman_code_lengths(distLen, distFreq, 30, 15);
+
+    int numLit = 286, numDist = 30;
+    while (numLit > 257 && !litLen[numLit - 1]) --numLit;
+    while (numDist > 1 && !distLen[numDist - 1]) --numDist;
+
+    // the code lengths, run-length encoded with symbols 16 (repeat), 17 and 18 (zeros)
+    std::vector<unsigned> all(litLen, litLen + numLit);
+    all.insert(all.end(), distLen, distLen + numDist);
+
+    std::vector<uint8_t> rle, rleExtra;
+    unsigned clFreq[19] = {};
+    for (size_t i = 0; i < all.size();) {
+        unsigned len = all[i];
+        size_t run = 1;
+        while (i + run < all.size() && all[i + run] == len) ++run;
+
+        if (len == 0 && run >= 3) {
+            run = std::min<size_t>(run, 138);
+            rle.push_back(run >= 11 ? 18 : 17);
+            rleExtra.push_back((uint8_t)(run >= 11 ? run - 11 : run - 3));
+        } else if (len != 0 && run >= 4) {
+            run = std::min<size_t>(run, 7);
+            rle.push_back((uint8_t)len);
+            rleExtra.push_back(0);
+            rle.push_back(16);
+            rleExtra.push_back((uint8_t)(run - 4));
+        } else {
+            run = 1;
+            rle.push_back((uint8_t)len);
+            rleExtra.push_back(0);
+        }
+        i += run;
+    }
+    for (uint8_t sym : rle) {
+        clFreq[sym] += 1;
+    }
+
+    unsigned clLen[19];
+    lodepng_huffman_code_lengths(clLen, clFreq, 19, 7);
+    int numCl = 19;
+    while (numCl > 4 && !clLen[gCodeLengthOrder[numCl - 1]]) --numCl;
+
+    uint16_t litCodes[286], distCodes[30], clCodes[19];
+    canonical_codes(litLen, 286, litCodes);
+    canonical_codes(distLen, 30, distCodes);
+    canonical_codes(clLen, 19, clCodes);
+
+    out.put(0 | (2 << 1), 3);     // BFINAL = 0, BTYPE = 10
+    out.put(numLit - 257, 5);
+    out.put(numDist - 1, 5);
+    out.put(numCl - 4, 4);
+    for (int i = 0; i < numCl; ++i) {
+        out.put(clLen[gCodeLengthOrder[i]], 3);
+    }
+    for (size_t i = 0; i < rle.size(); ++i) {
+        uint8_t sym = rle[i];
+        out.put(clCodes[sym], clLen[sym]);
+        if (sym >= 16) {
+            out.put(rleExtra[i], sym == 16 ? 2 : (sym == 17 ? 3 : 7));
+        }
+    }
+
+    for (const Token& t : tokens) {
+        if (t.dist) {
+            int li = code_index(gLengthBase, 29, t.value);
+            out.put(litCodes[257 + li], litLen[257 + li]);
+            out.put(t.value - gLengthBase[li], gLengthExtra[li]);
+
+            int di = code_index(gDistBase, 30, t.dist);
+            out.put(distCodes[di], distLen[di]);
+            out.put(t.dist - gDistBase[di], gDistExtra[di]);
+        } else {
+            out.put(litCodes[t.value], litLen[t.value]);
+        }
+    }
+    out.put(litCodes[256], litLen[256]);
+}
+
+struct EncodedChunk {
+    std::vector<uint8_t> fBytes;
+    uint32_t fAdler;
+    size_t   fRawSize;      // bytes before compression
+};
+
+// Convert, filter and compress rows [y0, y1) of bm. prevRow is the (converted) row above y0, or
+// null to convert it from bm.
+static void encode_rows(const GBitmap& bm, int y0, int y1, const uint8_t prevRow[],
+                        GBitmap::PNGLevel level, EncodedChunk* chunk) {
+    const bool fast = level == GBitmap::kFast_PNGLevel;
+    const std::vector<int> types = fast ? std::vector<int>{ 1, 2 } : std::vector<int>{ 0, 1, 2, 3, 4 };
+    const int maxChain = fast ? 4 : 32;
+
+    const size_t n = bm.width() * 4;
+    std::vector<uint8_t> prev(n, 0), row(n), tmp;
+    if (prevRow) {
+        memcpy(prev.data(), prevRow, n);
+    } else if (y0 > 0) {
+        convertToPNG(bm.getAddr(0, y0 - 1), bm.width(), prev.data());
+    }
+
+    std::vector<uint8_t> raw((y1 - y0) * (n + 1));
+    for (int y = y0; y < y1; ++y) {
+        convertToPNG(bm.getAddr(0, y), bm.width(), row.data());
+        filter_row_best(row.data(), prev.data(), n, &raw[(y - y0) * (n + 1)], types, tmp);
+        prev.swap(row);
+    }
+
+    BitWriter out(chunk->fBytes);
+    deflate_block(raw.data(), raw.size(), maxChain, out);
+    out.syncFlush();
+
+    chunk->fAdler = adler32(1, raw.data(), raw.size());
+    chunk->fRawSize = raw.size();
+}
+
+
+bool GPNGWriter::begin(const char path[], int width, int height, GBitmap::PNGLevel level, int threads) {
+    this->close();
+
+    fFile = fopen(path, "wb");
+    if (!fFile) {
+        return false;
+    }
+    fWidth = width;
+    fHeight = height;
+    fRowsWritten = 0;
+    fLevel = level;
+    fThreads = threads > 0 ? threads : std::max(1u, std::thread::hardware_concurrency());
+    fPrevRow.assign(width * 4, 0);
+    fAdler = 1;
+
+    const uint8_t signature[] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+    const uint8_t ihdr[] = {
+        'I', 'H', 'D', 'R',
+        (uint8_t)(width >> 24), (uint8_t)(width >> 16), (uint8_t)(width >> 8), (uint8_t)width,
+        (uint8_t)(height >> 24), (uint8_t)(height >> 16), (uint8_t)(height >> 8), (uint8_t)height,
+        8, 6, 0, 0, 0,      // 8 bits per channel, RGBA, deflate, adaptive filters, no interlace
+    };
+    if (fwrite(signature, 1, 8, fFile) != 8 || !write_chunk(fFile, ihdr, sizeof(ihdr))) {
+        this->close();
+        return false;
+    }
+
+    // zlib header: deflate with a 32K window, and the level as a hint (FLEVEL 0 or 2)
+    fChunk.assign(4, 0);
+    fChunk.push_back(0x78);
+    fChunk.push_back(level == GBitmap::kFast_PNGLevel ? 0x01 : 0x9C);
+    return true;
+}
+
+bool GPNGWriter::writeRows(const GBitmap& bm, int count) {
+    assert(bm.width() == fWidth && count <= bm.height());
+    if (!fFile || fRowsWritten + count > fHeight) {
+        return false;
+    }
+    if (count == 0) {
+        return true;
+    }
+
+    // enough rows per chunk that the per-block overhead (codes, flush) stays small
+    const int kMinRowsPerChunk = 16;
+    int chunkCount = std::max(1, std::min(fThreads, count / kMinRowsPerChunk));
+
+    std::vector<EncodedChunk> chunks(chunkCount);
+    auto encode = [&](int i) {
+        int y0 = (int)((int64_t)count * i / chunkCount);
+        int y1 = (int)((int64_t)count * (i + 1) / chunkCount);
+        encode_rows(bm, y0, y1, i == 0 ? fPrevRow.data() : nullptr, fLevel, &chunks[i]);
+    };
+
+    std::vector<std::thread> workers;
+    for (int i = 1; i < chunkCount; ++i) {
+        workers.emplace_back(encode, i);
+    }
+    encode(0);
+    for (auto& w : workers) {
+        w.join();
+    }
+
+    for (const EncodedChunk& chunk : chunks) {
+        fChunk.insert(fChunk.end(), chunk.fBytes.begin(), chunk.fBytes.end());
+        fAdler = adler32_combine(fAdler, chunk.fAdler, chunk.fRawSize);
+    }
+    convertToPNG(bm.getAddr(0, count - 1), fWidth, fPrevRow.data());
+    fRowsWritten += count;
+
+    if (!this->flushChunk()) {
+        this->close();
+        return false;
+    }
+    return true;
+}
+
+bool GPNGWriter::end() {
+    if (!fFile) {
+        return false;
+    }
+
+    // an empty final block, then pad to a byte and add the zlib checksum
+    BitWriter out(fChunk);
+    out.put(1 | (1 << 1), 3);       // BFINAL = 1, BTYPE = 01 (fixed codes)
+    out.put(0, 7);                  // end of block: 256 is 0000000 in the fixed codes
+    out.align();
+    for (int shift = 24; shift >= 0; shift -= 8) {
+        out.put((fAdler >> shift) & 0xFF, 8);
+    }
+
+    bool ok = fRowsWritten == fHeight && this->flushChunk() && write_chunk(fFile, (const uint8_t*)"IEND", 4);
+    ok &= fclose(fFile) == 0;
+    fFile = nullptr;
+    return ok;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+// premultiplied[a][c] = (a * c + 127) / 255
+struct PremulTable {
+    uint8_t fTable[256][256];
+
+    PremulTable() {
+        for (unsigned a = 0; a < 256; ++a) {
+            for (unsigned c = 0; c < 256; ++c) {
+                fTable[a][c] = (a * c + 127) / 255;
+            }
+        }
+    }
+};
+
+// Turn lodepng's RGBA bytes into premultiplied GPixels in place, one row of the table per pixel
+// instead of a division per channel. Returns true if every pixel is opaque.
+static bool premultiply_rgba_in_place(uint8_t pix[], size_t count) {
+    static const PremulTable gPremul;
+
+    unsigned alphaAnd = 0xFF;
+    for (size_t i = 0; i < count; ++i) {
+        const uint8_t* src = pix + i * 4;
         unsigned a = src[3];
-        dst[i] = GPixel_PackARGB(a,
-                                 alpha_mul(a, src[0]),
-                                 alpha_mul(a, src[1]),
-                                 alpha_mul(a, src[2]));
-        src += 4;
+        const uint8_t* mul = gPremul.fTable[a];
+
+        alphaAnd &= a;
+        GPixel p = GPixel_PackARGB(a, mul[src[0]], mul[src[1]], mul[src[2]]);
+        memcpy(pix + i * 4, &p, 4);
     }
+    return alphaAnd == 0xFF;
 }
 
+// lodepng's output (malloc'd) becomes the bitmap's pixels, so the decode needs no second buffer,
+// and opacity is known from the swizzle without another pass.
 bool GBitmap::readFromFile(const char path[]) {
     unsigned w, h;
     unsigned char* pix = nullptr;
     if (lodepng_decode32_file(&pix, &w, &h, path)) {
         free(pix);
+        this->reset();
         return false;
     }
 
-    this->alloc(w, h);
-
-    GPixel* dst = this->pixels();
-    const uint8_t* src = pix;
-    size_t rb = w * 4;
-    for (unsigned y = 0; y < h; ++y) {
-        swizzle_rgba_row(dst, src, w);
-        src += rb;
-        dst += this->rowBytes() / 4;
-    }
-    free(pix);
-
-    this->setIsOpaque(kCompute_IsOpaque);
+    bool opaque = premultiply_rgba_in_place(pix, (size_t)w * h);
+    this->reset(w, h, w * sizeof(GPixel), (GPixel*)pix, opaque ? kYes_IsOpaque : kNo_IsOpaque);
     return true;
 }
-
-
@@ -0,0 +1,103 @@
+/**
+ *  The raw pixel container used by GBitmap::writeToRawFile() and mapFromFile().
+ */
+
+#include "../include/GBitmap.h"
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// The header fills the first 64 bytes, so with a page-aligned mapping every row starts on a
+// 64-byte (cache line) boundary.
+struct RawHeader {
+    char     fMagic[4];     // "GRAW"
+    uint32_t fVersion;
+    uint32_t fByteOrder;    // kByteOrder as written, to reject files from another endianness
+    uint32_t fWidth;
+    uint32_t fHeight;
+    uint32_t fRowBytes;
+    uint32_t fIsOpaque;
+    uint8_t  fReserved[36];
+};
+
+static_assert(sizeof(RawHeader) == 64, "the pixels must start 64-byte aligned");
+
+static const char     kMagic[4] = { 'G', 'R', 'A', 'W' };
+static const uint32_t kVersion = 1;
+static const uint32_t kByteOrder = 0x01020304;
+static const size_t   kRowAlign = 64;
+
+bool GBitmap::writeToRawFile(const char path[]) const {
+    RawHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.fMagic, kMagic, 4);
+    header.fVersion = kVersion;
+    header.fByteOrder = kByteOrder;
+    header.fWidth = this->width();
+    header.fHeight = this->height();
+    header.fRowBytes = (this->width() * sizeof(GPixel) + kRowAlign - 1) & ~(kRowAlign - 1);
+    header.fIsOpaque = this->isOpaque();
+
+    FILE* f = fopen(path, "wb");
+    if (!f) {
+        return false;
+    }
+
+    bool ok = fwrite(&header, sizeof(header), 1, f) == 1;
+
+    const size_t used = this->width() * sizeof(GPixel);
+    const uint8_t zeros[kRowAlign] = {};
+    for (int y = 0; ok && y < this->height(); ++y) {
+        ok = fwrite(this->getAddr(0, y), 1, used, f) == used &&
+             fwrite(zeros, 1, header.fRowBytes - used, f) == header.fRowBytes - used;
+    }
+    return (fclose(f) == 0) && ok;
+}
+
+bool GBitmap::mapFromFile(const char path[]) {
+    this->reset();
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat st;
+    RawHeader header;
+    bool ok = fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(header) &&
+              pread(fd, &header, sizeof(header), 0) == (ssize_t)sizeof(header) &&
+              !memcmp(header.fMagic, kMagic, 4) && header.fVersion == kVersion &&
+              header.fByteOrder == kByteOrder &&
+              // GBitmap keeps its size in ints and addresses rows as whole GPixels
+              header.fWidth <= INT_MAX && header.fHeight <= INT_MAX &&
+              header.fRowBytes % sizeof(GPixel) == 0 &&
+              header.fRowBytes >= header.fWidth * sizeof(GPixel) &&
+              (size_t)st.st_size >= sizeof(header) + (size_t)header.fRowBytes * header.fHeight;
+
+    void* addr = MAP_FAILED;
+    if (ok) {
+        size_t length = sizeof(header) + (size_t)header.fRowBytes * header.fHeight;
+        addr = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);      // the mapping keeps the file alive
+
+    if (addr == MAP_FAILED) {
+        return false;
+    }
+
+    GPixel* pixels = (GPixel*)((char*)addr + sizeof(header));
+    this->reset(header.fWidth, header.fHeight, header.fRowBytes, pixels,
+                header.fIsOpaque ? kYes_IsOpaque : kNo_IsOpaque);
+    return true;
+}
+
+void GBitmap::unmapFile() {
+    if (fPixels) {
+        munmap((char*)fPixels - sizeof(RawHeader), sizeof(RawHeader) + fRowBytes * fHeight);
+    }
+    this->reset();
+}
@@ -12,6 +12,7 @@ GPath& GPath::operator=(const GPath& src) {
     if (this != &src) {
         fPts = src.fPts;
         fVbs = src.fVbs;
+        fFillType = src.fFillType;
     }
     return *this;
 }
@@ -19,6 +20,7 @@ GPath& GPath::operator=(const GPath& src) {
 void GPath::reset() {
     fPts.clear();
     fVbs.clear();
+    fFillType = kWinding_FillType;
 }
 
 void GPath::dump() const {
@@ -0,0 +1,167 @@
+#include "../include/GProfile.h"
+#include "../include/GShader.h"
+#include "../include/GTime.h"
+
+#include <atomic>
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <set>
+#include <stdlib.h>
+#include <typeinfo>
+
+namespace {
+
+constexpr int kModeCount = (int)GBlendMode::kXor + 1;
+
+const char* gModeNames[kModeCount] = {
+    "clear", "src", "dst", "srcOver", "dstOver", "srcIn", "dstIn", "srcOut", "dstOut",
+    "srcATop", "dstATop", "xor",
+};
+
+const char* gStageNames[GProfile::kStageCount] = {
+    "edges", "sort", "scan", "shade", "blend",
+};
+
+// Draws may run on several threads (e.g. picture strips), so the totals are atomics; only the
+// timer nesting and the current mode are per thread.
+std::atomic<uint64_t> gEdges;
+std::atomic<uint64_t> gSpans;
+std::atomic<uint64_t> gBlended[kModeCount];
+std::atomic<uint64_t> gStageNSec[GProfile::kStageCount];
+
+// Pixels shaded by each shader class (keyed by typeid name), counted per thread so a span takes
+// no lock. Each thread's counts register themselves when first used and fold into gShadedDone
+// when the thread exits; Dump and Reset expect no draws to be running.
+struct ShadedCounts;
+
+std::mutex                      gShadedMutex;
+std::set<ShadedCounts*>         gShadedThreads;
+std::map<const char*, uint64_t> gShadedDone;
+
+struct ShadedCounts {
+    std::map<const char*, uint64_t> fPixels;
+
+    ShadedCounts() {
+        std::lock_guard<std::mutex> lock(gShadedMutex);
+        gShadedThreads.insert(this);
+    }
+    ~ShadedCounts() {
+        std::lock_guard<std::mutex> lock(gShadedMutex);
+        for (const auto& iter : fPixels) {
+            gShadedDone[iter.first] += iter.second;
+        }
+        gShadedThreads.erase(this);
+    }
+};
+
+thread_local ShadedCounts gShaded;
+thread_local int        gStage = -1;
+thread_local GNSec      gStageStart;
+thread_local GBlendMode gMode = GBlendMode::kSrcOver;
+
+// Skip the length prefix of a mangled class name, e.g. "17MyGradientShader"
+const char* class_name(const char mangled[]) {
+    while (*mangled >= '0' && *mangled <= '9') {
+        ++mangled;
+    }
+    return mangled;
+}
+
+}
+
+bool GProfile::Enabled() {
+#ifdef G_PROFILE
+    return true;
+#else
+    return false;
+#endif
+}
+
+void GProfile::Reset() {
+    gEdges = 0;
+    gSpans = 0;
+    for (auto& count : gBlended) {
+        count = 0;
+    }
+    for (auto& nsec : gStageNSec) {
+        nsec = 0;
+    }
+    std::lock_guard<std::mutex> lock(gShadedMutex);
+    gShadedDone.clear();
+    for (ShadedCounts* counts : gShadedThreads) {
+        counts->fPixels.clear();
+    }
+}
+
+void GProfile::Dump(FILE* f, double draws) {
+    if (!Enabled()) {
+        fprintf(f, "    (profiling is compiled out: build with -DG_PROFILE)\n");
+        return;
+    }
+    draws = std::max(draws, 1.0);
+
+    fprintf(f, "    edges %.1f  spans %.1f\n", gEdges / draws, gSpans / draws);
+    for (int i = 0; i < kModeCount; ++i) {
+        if (gBlended[i]) {
+            fprintf(f, "    blended %-8s %.0f px\n", gModeNames[i], gBlended[i] / draws);
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(gShadedMutex);
+        std::map<const char*, uint64_t> shaded = gShadedDone;
+        for (const ShadedCounts* counts : gShadedThreads) {
+            for (const auto& iter : counts->fPixels) {
+                shaded[iter.first] += iter.second;
+            }
+        }
+        for (const auto& iter : shaded) {
+            fprintf(f, "    shaded  %-20s %.0f px\n", class_name(iter.first), iter.second / draws);
+        }
+    }
+
+    uint64_t total = 0;
+    for (const auto& nsec : gStageNSec) {
+        total += nsec;
+    }
+    for (int i = 0; i < kStageCount; ++i) {
+        if (gStageNSec[i]) {
+            fprintf(f, "    %-6s %10.4f ms %5.1f%%\n", gStageNames[i],
+                    gStageNSec[i] * 1e-6 / draws, gStageNSec[i] * 100.0 / total);
+        }
+    }
+}
+
+void GProfile::AddEdges(int count) {
+    gEdges.fetch_add(count, std::memory_order_relaxed);
+}
+
+void GProfile::AddSpan(int pixels) {
+    gSpans.fetch_add(1, std::memory_order_relaxed);
+    gBlended[(int)gMode].fetch_add(pixels, std::memory_order_relaxed);
+}
+
+void GProfile::AddShaded(const GShader* sh, int pixels) {
+    gShaded.fPixels[typeid(*sh).name()] += pixels;
+}
+
+void GProfile::SetMode(GBlendMode mode) {
+    gMode = mode;
+}
+
+GProfile::Timer::Timer(Stage stage) {
+    GNSec now = GTime::GetNSec();
+    if (gStage >= 0) {
+        gStageNSec[gStage].fetch_add(now - gStageStart, std::memory_order_relaxed);
+    }
+    fPrev = gStage;
+    gStage = stage;
+    gStageStart = now;
+}
+
+GProfile::Timer::~Timer() {
+    GNSec now = GTime::GetNSec();
+    gStageNSec[gStage].fetch_add(now - gStageStart, std::memory_order_relaxed);
+    gStage = fPrev;
+    gStageStart = now;
+}
@@ -0,0 +1,561 @@
+#include "include/GTrace.h"
+#include "include/GBitmap.h"
+#include "include/GPath.h"
+#include "include/GPicture.h"
+#include "include/GShader.h"
+#include <map>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+namespace {
+
+// A trace is this header, then each call as a one-byte op followed by its paint (if it has
+// one) and its arguments. Everything is in the writer's byte order, which the header records,
+// so a trace from a machine of the other order is rejected rather than misread.
+struct TraceHeader {
+  char magic[4];          // "GTRC"
+  uint32_t version;
+  uint32_t byteOrder;
+  int32_t width;
+  int32_t height;
+};
+
+const char kMagic[4] = { 'G', 'T', 'R', 'C' };
+const uint32_t kVersion = 1;
+const uint32_t kByteOrder = 0x01020304;
+
+enum class TraceOp : uint8_t {
+  kBitmap,                // id, width, height, opaque, then the pixels row by row
+  kSave, kSaveLayer, kRestore, kConcat, kClipRect, kClipPath,
+  kClear, kRect, kConvexPolygon, kPolyline, kPath, kMesh, kQuad,
+  kLast = kQuad,
+};
+
+enum ShaderType : uint8_t { kNoShader, kBitmapShader, kGradientShader };
+
+// which of the optional per-vertex arrays a mesh or quad has
+enum VertexFlags : uint8_t { kHasColors = 1, kHasTexs = 2 };
+
+class TraceCanvas : public GCanvas {
+  public:
+    TraceCanvas(FILE* file, GISize size, GCanvas* target) : fFile(file), fTarget(target) {
+      TraceHeader header;
+      memcpy(header.magic, kMagic, 4);
+      header.version = kVersion;
+      header.byteOrder = kByteOrder;
+      header.width = size.width;
+      header.height = size.height;
+      fBuffer.reserve(kFlushSize);
+      this->write(header);
+    }
+
+    ~TraceCanvas() override {
+      this->flush();
+      fclose(fFile);
+    }
+
+    void save() override {
+      this->writeOp(TraceOp::kSave);
+      if (fTarget) fTarget->save();
+    }
+
+    void saveLayer(const GRect* bounds, const GPaint& paint) override {
+      this->writeOp(TraceOp::kSaveLayer, &paint);
+      this->write<uint8_t>(bounds != nullptr);
+      if (bounds) this->write(*bounds);
+      if (fTarget) fTarget->saveLayer(bounds, paint);
+    }
+
+    void restore() override {
+      this->writeOp(TraceOp::kRestore);
+      if (fTarget) fTarget->restore();
+    }
+
+    void concat(const GMatrix& matrix) override {
+      this->writeOp(TraceOp::kConcat);
+      this->write(matrix);
+      if (fTarget) fTarget->concat(matrix);
+    }
+
+    void clipRect(const GRect& rect) override {
+      this->writeOp(TraceOp::kClipRect);
+      this->write(rect);
+      if (fTarget) fTarget->clipRect(rect);
+    }
+
+    void clipPath(const GPath& path) override {
+      this->writeOp(TraceOp::kClipPath);
+      this->writePath(path);
+      if (fTarget) fTarget->clipPath(path);
+    }
+
+    GIRect getDamage() const override {
+      return fTarget ? fTarget->getDamage() : GIRect::LTRB(0, 0, 0, 0);
+    }
+
+    void resetDamage() override {
+      if (fTarget) fTarget->resetDamage();
+    }
+
+    void clear(const GColor& color) override {
+      this->writeOp(TraceOp::kClear);
+      this->write(color);
+      if (fTarget) fTarget->clear(color);
+    }
+
+    void drawRect(const GRect& rect, const GPaint& paint) override {
+      this->writeOp(TraceOp::kRect, &paint);
+      this->write(rect);
+      if (fTarget) fTarget->drawRect(rect, paint);
+    }
+
+    void drawConvexPolygon(const GPoint pts[], int count, const GPaint& paint) override {
+      this->writeOp(TraceOp::kConvexPolygon, &paint);
+      this->writeArray(pts, count);
+      if (fTarget) fTarget->drawConvexPolygon(pts, count, paint);
+    }
+
+    void drawPolyline(const GPoint pts[], int count, const GPaint& paint) override {
+      this->writeOp(TraceOp::kPolyline, &paint);
+      this->writeArray(pts, count);
+      if (fTarget) fTarget->drawPolyline(pts, count, paint);
+    }
+
+    void drawPath(const GPath& path, const GPaint& paint) override {
+      this->writeOp(TraceOp::kPath, &paint);
+      this->writePath(path);
+      if (fTarget) fTarget->drawPath(path, paint);
+    }
+
+    void drawMesh(const GPoint verts[], const GColor colors[], const GPoint texs[],
+                  int count, const int indices[], const GPaint& paint) override {
+      this->writeOp(TraceOp::kMesh, &paint);
+
+      // only the vertices the indices reach
+      int n = 0;
+      for (int i = 0; i < count * 3; i++) n = std::max(n, indices[i] + 1);
+
+      this->write<uint8_t>((colors ? kHasColors : 0) | (texs ? kHasTexs : 0));
+      this->writeArray(verts, n);
+      if (colors) this->write(colors, n * sizeof(GColor));
+      if (texs) this->write(texs, n * sizeof(GPoint));
+      this->writeArray(indices, count * 3);
+
+      if (fTarget) fTarget->drawMesh(verts, colors, texs, count, indices, paint);
+    }
+
+    void drawQuad(const GPoint verts[4], const GColor colors[4], const GPoint texs[4],
+                  int level, const GPaint& paint) override {
+      this->writeOp(TraceOp::kQuad, &paint);
+      this->write<uint8_t>((colors ? kHasColors : 0) | (texs ? kHasTexs : 0));
+      this->write(verts, 4 * sizeof(GPoint));
+      if (colors) this->write(colors, 4 * sizeof(GColor));
+      if (texs) this->write(texs, 4 * sizeof(GPoint));
+      this->write<int32_t>(level);
+
+      if (fTarget) fTarget->drawQuad(verts, colors, texs, level, paint);
+    }
+
+  private:
+    static constexpr size_t kFlushSize = 1 << 20;
+
+    struct BitmapRef {
+      int width, height;
+      uint32_t id;
+    };
+
+    FILE* fFile;
+    GCanvas* fTarget;
+    std::vector<uint8_t> fBuffer;
+    std::map<const GPixel*, BitmapRef> fBitmaps;
+    uint32_t fNextBitmapID = 0;
+
+    void flush() {
+      if (!fBuffer.empty()) fwrite(fBuffer.data(), 1, fBuffer.size(), fFile);
+      fBuffer.clear();
+    }
+
+    void write(const void* data, size_t size) {
+      const uint8_t* bytes = (const uint8_t*) data;
+      fBuffer.insert(fBuffer.end(), bytes, bytes + size);
+      if (fBuffer.size() >= kFlushSize) this->flush();
+    }
+
+    template <typename T> void write(const T& value) { this->write(&value, sizeof(T)); }
+
+    template <typename T> void writeArray(const T values[], int count) {
+      this->write<int32_t>(count);
+      this->write(values, count * sizeof(T));
+    }
+
+    // The op, then its paint. A bitmap the paint's shader draws is defined first, if it hasn't
+    // been already, since the paint refers to it by id.
+    void writeOp(TraceOp op, const GPaint* paint = nullptr) {
+      GShaderDesc desc;
+      bool described = paint && paint->getShader() && paint->getShader()->describe(&desc);
+      uint32_t bitmapID = 0;
+      if (described && desc.type == GShaderDesc::kBitmap) {
+        bitmapID = this->defineBitmap(*desc.bitmap);
+      }
+
+      this->write(op);
+      if (!paint) return;
+
+      this->write(paint->getColor());
+      this->write<uint8_t>((uint8_t) paint->getBlendMode());
+      if (!described) {
+        this->write<uint8_t>(kNoShader);
+      } else if (desc.type == GShaderDesc::kBitmap) {
+        this->write<uint8_t>(kBitmapShader);
+        this->write<uint8_t>((uint8_t) desc.tileMode);
+        this->write(bitmapID);
+        this->write(desc.localMatrix);
+      } else {
+        this->write<uint8_t>(kGradientShader);
+        this->write<uint8_t>((uint8_t) desc.tileMode);
+        this->write(desc.p0);
+        this->write(desc.p1);
+        this->writeArray(desc.colors.data(), (int) desc.colors.size());
+      }
+    }
+
+    uint32_t defineBitmap(const GBitmap& bm) {
+      auto iter = fBitmaps.find(bm.pixels());
+      if (iter != fBitmaps.end() && iter->second.width == bm.width() &&
+          iter->second.height == bm.height()) {
+        return iter->second.id;
+      }
+
+      uint32_t id = fNextBitmapID++;
+      fBitmaps[bm.pixels()] = { bm.width(), bm.height(), id };
+
+      this->write(TraceOp::kBitmap);
+      this->write(id);
+      this->write<int32_t>(bm.width());
+      this->write<int32_t>(bm.height());
+      this->write<uint8_t>(bm.isOpaque());
+      for (int y = 0; y < bm.height(); y++) {
+        this->write(bm.getAddr(0, y), bm.width() * sizeof(GPixel));
+      }
+      return id;
+    }
+
+    // each verb with the points it adds
+    void writePath(const GPath& path) {
+      std::vector<uint8_t> verbs;
+      std::vector<GPoint> pts;
+      GPoint p[GPath::kMaxNextPoints];
+      GPath::Iter iter(path);
+
+      while (auto verb = iter.next(p)) {
+        verbs.push_back((uint8_t) *verb);
+        switch (*verb) {
+          case GPath::kMove:  pts.push_back(p[0]); break;
+          case GPath::kLine:  pts.push_back(p[1]); break;
+          case GPath::kQuad:  pts.insert(pts.end(), p + 1, p + 3); break;
+          case GPath::kCubic: pts.insert(pts.end(), p + 1, p + 4); break;
+        }
+      }
+
+      this->write<uint8_t>((uint8_t) path.getFillType());
+      this->writeArray(verbs.data(), (int) verbs.size());
+      this->writeArray(pts.data(), (int) pts.size());
+    }
+};
+
+// Reads the values written above, failing (for good) at the first one that would run past
+// the end of the data.
+class TraceReader {
+  public:
+    TraceReader(const std::vector<uint8_t>& data) : fCurr(data.data()), fStop(data.data() + data.size()) {}
+
+    bool ok() const { return fOK; }
+    bool atEnd() const { return fCurr == fStop; }
+
+    bool read(void* dst, size_t size) {
+      if (!fOK || size > (size_t) (fStop - fCurr)) return fOK = false;
+      memcpy(dst, fCurr, size);
+      fCurr += size;
+      return true;
+    }
+
+    template <typename T> T read() {
+      T value;
+      if (!this->read(&value, sizeof(T))) memset((void*) &value, 0, sizeof(T));
+      return value;
+    }
+
+    template <typename T> bool readArray(std::vector<T>* values, size_t count) {
+      if (!fOK || count > (size_t) (fStop - fCurr) / sizeof(T)) return fOK = false;
+      values->resize(count);
+      return this->read(values->data(), count * sizeof(T));
+    }
+
+    // an int32 count, then that many values
+    template <typename T> bool readArray(std::vector<T>* values) {
+      int32_t count = this->read<int32_t>();
+      return count >= 0 ? this->readArray(values, count) : fOK = false;
+    }
+
+  private:
+    const uint8_t* fCurr;
+    const uint8_t* fStop;
+    bool fOK = true;
+};
+
+// A trace is decoded once into a picture, which owns the paths and meshes, while the trace
+// owns the bitmaps and shaders its paints point at.
+class Trace : public GTrace {
+  public:
+    ~Trace() override {
+      for (const GBitmap& bm : fBitmaps) free(bm.pixels());
+    }
+
+    GISize size() const override { return fSize; }
+    int countCalls() const override { return fPicture->countOps(); }
+    void playback(GCanvas* canvas) const override { fPicture->playbackAll(canvas); }
+
+    bool decode(TraceReader& reader) {
+      TraceHeader header;
+      if (!reader.read(&header, sizeof(header)) || memcmp(header.magic, kMagic, 4) ||
+          header.version != kVersion || header.byteOrder != kByteOrder ||
+          header.width <= 0 || header.height <= 0) {
+        return false;
+      }
+      fSize = { header.width, header.height };
+
+      GPictureRecorder recorder;
+      GCanvas* canvas = recorder.beginRecording(fSize.width, fSize.height);
+      int depth = 0;
+
+      while (!reader.atEnd()) {
+        uint8_t op = reader.read<uint8_t>();
+        if (!reader.ok() || op > (uint8_t) TraceOp::kLast) return false;
+
+        if ((TraceOp) op == TraceOp::kBitmap) {
+          if (!this->decodeBitmap(reader)) return false;
+          continue;
+        }
+
+        GPaint paint;
+        switch ((TraceOp) op) {
+          case TraceOp::kSaveLayer: case TraceOp::kRect: case TraceOp::kConvexPolygon:
+          case TraceOp::kPolyline: case TraceOp::kPath: case TraceOp::kMesh: case TraceOp::kQuad:
+            if (!this->decodePaint(reader, &paint)) return false;
+            break;
+          default:
+            break;
+        }
+
+        switch ((TraceOp) op) {
+          case TraceOp::kBitmap:
+            break;
+          case TraceOp::kSave:
+            canvas->save();
+            depth++;
+            break;
+          case TraceOp::kSaveLayer: {
+            bool hasBounds = reader.read<uint8_t>();
+            GRect bounds = hasBounds ? reader.read<GRect>() : GRect();
+            if (!reader.ok()) return false;
+            canvas->saveLayer(hasBounds ? &bounds : nullptr, paint);
+            depth++;
+          } break;
+          case TraceOp::kRestore:
+            if (depth == 0) return false;
+            canvas->restore();
+            depth--;
+            break;
+          case TraceOp::kConcat: {
+            GMatrix matrix = reader.read<GMatrix>();
+            if (!reader.ok()) return false;
+            canvas->concat(matrix);
+          } break;
+          case TraceOp::kClipRect: {
+            GRect rect = reader.read<GRect>();
+            if (!reader.ok()) return false;
+            canvas->clipRect(rect);
+          } break;
+          case TraceOp::kClipPath: {
+            GPath path;
+            if (!decodePath(reader, &path)) return false;
+            canvas->clipPath(path);
+          } break;
+          case TraceOp::kClear: {
+            GColor color = reader.read<GColor>();
+            if (!reader.ok()) return false;
+            canvas->clear(color);
+          } break;
+          case TraceOp::kRect: {
+            GRect rect = reader.read<GRect>();
+            if (!reader.ok()) return false;
+            canvas->drawRect(rect, paint);
+          } break;
+          case TraceOp::kConvexPolygon:
+          case TraceOp::kPolyline: {
+            std::vector<GPoint> pts;
+            if (!reader.readArray(&pts)) return false;
+            if ((TraceOp) op == TraceOp::kConvexPolygon) {
+              canvas->drawConvexPolygon(pts.data(), (int) pts.size(), paint);
+            } else {
+              canvas->drawPolyline(pts.data(), (int) pts.size(), paint);
+            }
+          } break;
+          case TraceOp::kPath: {
+            GPath path;
+            if (!decodePath(reader, &path)) return false;
+            canvas->drawPath(path, paint);
+          } break;
+          case TraceOp::kMesh: {
+            uint8_t flags = reader.read<uint8_t>();
+            std::vector<GPoint> verts, texs;
+            std::vector<GColor> colors;
+            std::vector<int32_t> indices;
+            if (!reader.readArray(&verts) ||
+                ((flags & kHasColors) && !reader.readArray(&colors, verts.size())) ||
+                ((flags & kHasTexs) && !reader.readArray(&texs, verts.size())) ||
+                !reader.readArray(&indices) || indices.size() % 3) {
+              return false;
+            }
+            for (int32_t index : indices) {
+              if (index < 0 || (size_t) index >= verts.size()) return false;
+            }
+            canvas->drawMesh(verts.data(), colors.empty() ? nullptr : colors.data(),
+                             texs.empty() ? nullptr : texs.data(), (int) indices.size() / 3,
+                             indices.data(), paint);
+          } break;
+          case TraceOp::kQuad: {
+            uint8_t flags = reader.read<uint8_t>();
+            std::vector<GPoint> verts, texs;
+            std::vector<GColor> colors;
+            if (!reader.readArray(&verts, 4) ||
+                ((flags & kHasColors) && !reader.readArray(&colors, 4)) ||
+                ((flags & kHasTexs) && !reader.readArray(&texs, 4))) {
+              return false;
+            }
+            int32_t level = reader.read<int32_t>();
+            if (!reader.ok() || level < 0) return false;
+            canvas->drawQuad(verts.data(), colors.empty() ? nullptr : colors.data(),
+                             texs.empty() ? nullptr : texs.data(), level, paint);
+          } break;
+        }
+      }
+
+      fPicture = recorder.finishRecording();
+      return true;
+    }
+
+  private:
+    GISize fSize = { 0, 0 };
+    std::vector<GBitmap> fBitmaps;    // indexed by id
+    std::vector<std::unique_ptr<GShader>> fShaders;
+    std::unique_ptr<GPicture> fPicture;
+
+    bool decodeBitmap(TraceReader& reader) {
+      uint32_t id = reader.read<uint32_t>();
+      int32_t width = reader.read<int32_t>();
+      int32_t height = reader.read<int32_t>();
+      bool opaque = reader.read<uint8_t>();
+
+      // ids are handed out in order
+      std::vector<GPixel> pixels;
+      if (!reader.ok() || id != fBitmaps.size() || width <= 0 || height <= 0 ||
+          !reader.readArray(&pixels, (size_t) width * height)) {
+        return false;
+      }
+
+      GBitmap bm;
+      bm.alloc(width, height);
+      memcpy(bm.pixels(), pixels.data(), pixels.size() * sizeof(GPixel));
+      bm.setIsOpaque(opaque ? GBitmap::kYes_IsOpaque : GBitmap::kNo_IsOpaque);
+      fBitmaps.push_back(bm);
+      return true;
+    }
+
+    bool decodePaint(TraceReader& reader, GPaint* paint) {
+      paint->setColor(reader.read<GColor>());
+      uint8_t mode = reader.read<uint8_t>();
+      uint8_t shader = reader.read<uint8_t>();
+      if (!reader.ok() || mode > (uint8_t) GBlendMode::kXor || shader > kGradientShader) {
+        return false;
+      }
+      paint->setBlendMode((GBlendMode) mode);
+      if (shader == kNoShader) return true;
+
+      uint8_t tile = reader.read<uint8_t>();
+      if (!reader.ok() || tile > (uint8_t) GTileMode::kMirror) return false;
+
+      if (shader == kBitmapShader) {
+        uint32_t id = reader.read<uint32_t>();
+        GMatrix local = reader.read<GMatrix>();
+        if (!reader.ok() || id >= fBitmaps.size()) return false;
+        fShaders.push_back(GCreateBitmapShader(fBitmaps[id], local, (GTileMode) tile));
+      } else {
+        GPoint p0 = reader.read<GPoint>();
+        GPoint p1 = reader.read<GPoint>();
+        std::vector<GColor> colors;
+        if (!reader.readArray(&colors) || colors.empty()) return false;
+        fShaders.push_back(GCreateLinearGradient(p0, p1, colors.data(), (int) colors.size(),
+                                                 (GTileMode) tile));
+      }
+      paint->setShader(fShaders.back().get());
+      return fShaders.back() != nullptr;
+    }
+
+    static bool decodePath(TraceReader& reader, GPath* path) {
+      uint8_t fillType = reader.read<uint8_t>();
+      std::vector<uint8_t> verbs;
+      std::vector<GPoint> pts;
+      if (!reader.ok() || fillType > GPath::kInverseEvenOdd_FillType ||
+          !reader.readArray(&verbs) || !reader.readArray(&pts)) {
+        return false;
+      }
+
+      size_t n = 0;
+      for (size_t i = 0; i < verbs.size(); i++) {
+        // a path starts with a move, and each verb adds as many points as its degree
+        static const size_t kPointCount[] = { 1, 1, 2, 3 };
+        if (verbs[i] > GPath::kCubic || (i == 0 && verbs[i] != GPath::kMove) ||
+            pts.size() - n < kPointCount[verbs[i]]) {
+          return false;
+        }
+        const GPoint* p = &pts[n];
+        switch (verbs[i]) {
+          case GPath::kMove:  path->moveTo(p[0]); break;
+          case GPath::kLine:  path->lineTo(p[0]); break;
+          case GPath::kQuad:  path->quadTo(p[0], p[1]); break;
+          case GPath::kCubic: path->cubicTo(p[0], p[1], p[2]); break;
+        }
+        n += kPointCount[verbs[i]];
+      }
+      path->setFillType((GPath::FillType) fillType);
+      return n == pts.size();
+    }
+};
+
+}
+
+std::unique_ptr<GCanvas> GCreateTraceCanvas(const char path[], GISize size, GCanvas* target) {
+  FILE* file = fopen(path, "wb");
+  if (!file) return nullptr;
+  return std::unique_ptr<GCanvas>(new TraceCanvas(file, size, target));
+}
+
+std::unique_ptr<GTrace> GLoadTrace(const char path[]) {
+  FILE* file = fopen(path, "rb");
+  if (!file) return nullptr;
+
+  std::vector<uint8_t> data;
+  uint8_t chunk[1 << 16];
+  size_t n;
+  while ((n = fread(chunk, 1, sizeof(chunk), file)) > 0) {
+    data.insert(data.end(), chunk, chunk + n);
+  }
+  fclose(file);
+
+  TraceReader reader(data);
+  std::unique_ptr<Trace> trace(new Trace);
+  if (!trace->decode(reader)) return nullptr;
+  return std::move(trace);
+}